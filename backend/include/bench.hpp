@@ -0,0 +1,122 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "buffer.hpp"
+#include "client.hpp"
+#include "histogram.hpp"
+
+namespace ChatServer {
+
+    struct BenchOptions {
+        std::string host = "127.0.0.1";
+        int port = 12345;
+        int clients = 1000;
+        int threads = 4;
+        int duration = 10;          // seconds of measured load
+        double rate = 1.0;          // operations per client per second
+        int group_size = 10;        // clients per /gmsg group
+        int file_size = 64 * 1024;  // bytes per relayed upload
+        std::string prefix = "bench";
+
+        // Relative weights of the workload mix
+        int broadcast = 5;
+        int msg = 55;
+        int gmsg = 30;
+        int list = 5;
+        int file = 5;
+    };
+
+    enum class BenchOp { BROADCAST, MSG, GMSG, LIST, FILE, COUNT };
+    constexpr size_t BENCH_OPS = (size_t)BenchOp::COUNT;
+
+    // What one worker measured; the driver merges them for the report
+    struct BenchStats {
+        std::array<LatencyHistogram, BENCH_OPS> latency;  // ns, send -> delivery
+        std::array<uint64_t, BENCH_OPS> sent{};
+        uint64_t frames_received = 0;
+        uint64_t bytes_received = 0;
+        uint64_t errors = 0;
+
+        void merge(const BenchStats& other);
+    };
+
+    enum class BenchPhase {
+        CONNECT,  // open sessions and log in
+        SETUP,    // group leaders create their groups and add members
+        RUN,      // issue the workload at the configured rate
+        DRAIN,    // stop issuing, keep collecting deliveries
+        STOP
+    };
+
+    // Progress shared between the driver and its workers
+    struct BenchShared {
+        std::atomic<BenchPhase> phase{BenchPhase::CONNECT};
+        std::atomic<int> connected{0};
+        std::atomic<int> logged_in{0};
+        std::atomic<int> members_added{0};
+        std::atomic<int> connect_failures{0};
+    };
+
+    // One load-generator thread: a slice of the simulated clients, all
+    // non-blocking on a private epoll instance. Each session is a Client in
+    // message framing, whose parser splits the replies so each can be matched;
+    // the worker only does the non-blocking sending.
+    class BenchWorker {
+    public:
+        BenchWorker(const BenchOptions& options, BenchShared& shared, int first_client, int client_count);
+        ~BenchWorker();
+
+        // Thread body: connect, log in, then drive the phases until STOP
+        void run();
+
+        const BenchStats& stats() const { return results; }
+
+    private:
+        struct Session {
+            std::unique_ptr<Client> client;
+            int id;                            // global client index
+            ByteBuffer outbound;
+            bool alive = true;
+            bool write_armed = false;
+            std::deque<uint64_t> list_sent;    // send times of unanswered /list
+        };
+
+        const BenchOptions& options;
+        BenchShared& shared;
+        int first_client;
+        int client_count;
+
+        int epoll_fd;
+        std::vector<Session> sessions;
+        std::mt19937_64 rng;
+        std::string file_payload;
+        BenchStats results;
+
+        void connectAll();
+        void setupGroups();
+        void issue(Session& session);
+        void handleReadable(Session& session);
+        void handleFrame(Session& session, std::string_view frame);
+        void queueFrame(Session& session, const std::string& text);
+        void queueRaw(Session& session, const char* data, size_t len);
+        void flush(Session& session);
+        void closeSession(Session& session);
+        BenchOp pickOp();
+        int pickPeer(int self);
+        std::string userName(int id) const;
+        std::string groupName(int id) const;
+    };
+
+    void printBenchReport(const BenchOptions& options, const BenchStats& stats, double seconds);
+
+} // namespace ChatServer
+
+#endif // BENCH_HPP
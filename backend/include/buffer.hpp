@@ -0,0 +1,132 @@
+#ifndef BUFFER_HPP
+#define BUFFER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <sys/uio.h>   // iovec
+
+namespace ChatServer {
+
+    // Growable byte FIFO: append at the tail, consume from the head.
+    // Consumed space is reclaimed lazily so steady traffic never reallocates.
+    class ByteBuffer {
+    public:
+        void append(const char* data, size_t len);
+        void append(const std::string& data) { append(data.data(), data.size()); }
+
+        // Reserve `len` writable bytes at the tail; commit() what was actually written
+        char* prepare(size_t len);
+        void commit(size_t len) { tail += len; }
+
+        const char* data() const { return storage.data() + head; }
+        size_t size() const { return tail - head; }
+        bool empty() const { return head == tail; }
+
+        void consume(size_t len);
+        void clear() { head = tail = 0; }
+
+        // Give the storage back (a connection gone quiet); the next prepare() reallocates
+        void release() { std::vector<char>().swap(storage); head = tail = 0; }
+        size_t capacity() const { return storage.size(); }
+
+    private:
+        std::vector<char> storage;
+        size_t head = 0;
+        size_t tail = 0;
+    };
+
+    // Immutable payload built once and shared by every recipient's queue
+    using SharedBuffer = std::shared_ptr<const std::string>;
+
+    inline SharedBuffer makeBuffer(std::string data) {
+        return std::make_shared<const std::string>(std::move(data));
+    }
+
+    // Descriptor bytes are streamed from: a read-only file shared by every
+    // queue sending it, or one end of a relay pipe. Closed with the last reference.
+    struct FileSource {
+        explicit FileSource(int fd, bool pipe = false) : fd(fd), pipe(pipe) {}
+        ~FileSource();
+        FileSource(const FileSource&) = delete;
+        FileSource& operator=(const FileSource&) = delete;
+
+        int fd;
+        bool pipe;  // splice() from it instead of sendfile(); no offsets
+    };
+    using SharedFile = std::shared_ptr<const FileSource>;
+
+    enum class FlushResult {
+        DONE,      // queue is empty
+        BLOCKED,   // socket buffer full; wait for EPOLLOUT
+        YIELDED,   // file budget spent while the socket was still writable
+        STARVED,   // front is a relay pipe with nothing in it yet; wait for the pipe
+        FAILED     // hard error; the queue can't be delivered
+    };
+
+    // Bytes sent ahead of a queued payload. The queue doesn't know framings;
+    // its owner builds this per connection, so one payload can go to
+    // connections using different framings.
+    struct FrameHeader {
+        static constexpr size_t MAX_SIZE = 10;  // longest header any framing writes
+        std::array<char, MAX_SIZE> bytes{};
+        uint8_t size = 0;
+    };
+
+    // Per-connection outbound queue of shared payloads. Nothing is copied on
+    // push; flush() hands up to 64 segments to the kernel in one sendmsg().
+    // File ranges go straight from the page cache with sendfile(2), relay
+    // pipes with splice(2).
+    class OutboundQueue {
+    public:
+        static constexpr uint64_t FILE_BYTES_PER_FLUSH = 1u << 20;
+        static constexpr size_t MAX_IOV = 64;  // segments per sendmsg()
+
+        void push(SharedBuffer data, const FrameHeader& header = {});
+
+        // Queue `length` bytes of `file` from `offset` (ignored for pipes) behind `header`
+        void pushFile(const SharedFile& file, uint64_t offset, uint64_t length, const FrameHeader& header = {});
+
+        // Write as much as the socket takes, but at most FILE_BYTES_PER_FLUSH
+        // file bytes so one large transfer can't hold up the loop
+        FlushResult flush(int fd);
+
+        // For a send issued elsewhere (io_uring): iovecs for the in-memory
+        // bytes at the front, up to the next file range (0 when one is next).
+        // They stay valid until complete() reports how many bytes went out.
+        size_t gather(iovec* iov, size_t max) const;
+        void complete(size_t len) { consume(len); }
+
+        // In-memory bytes only; queued file ranges stay in the page cache
+        size_t size() const { return queued_bytes; }
+        uint64_t sentTotal() const { return sent_bytes; }  // everything written so far, files included
+        bool empty() const { return segments.empty(); }
+        void clear();
+
+        // Pipe the queue is waiting on after flush() returned STARVED
+        const FileSource& stalledOn() const { return *segments.front().file; }
+
+    private:
+        struct Segment {
+            SharedBuffer data;      // in-memory payload, or null for a file range
+            SharedFile file;
+            uint64_t file_offset;   // start of the range within file
+            uint64_t length;        // payload bytes, excluding the header
+            uint64_t offset = 0;    // bytes already sent, counting the header
+            FrameHeader header;     // sent first
+        };
+
+        std::deque<Segment> segments;
+        size_t queued_bytes = 0;
+        uint64_t sent_bytes = 0;
+
+        void consume(size_t len);
+    };
+
+} // namespace ChatServer
+
+#endif // BUFFER_HPP
@@ -2,31 +2,85 @@
 #define CLIENT_HPP
 
 #include <string>
+#include <string_view>
+#include <functional>
+#include <fstream>
+#include <cstdint>
 #include <netinet/in.h>
+#include "buffer.hpp"
+#include "message.hpp"
 
 namespace ChatServer {
 
     class Client {
     public:
+        // Run on the thread in listen()/receive(); views are only valid during the call
+        using MessageHandler = std::function<void(MessageType type, std::string_view content)>;
+        // Bytes of an incoming file as they arrive; `done` is set on the last call
+        using FileHandler = std::function<void(const std::string& filename, std::string_view bytes, bool done)>;
+
         Client(const std::string& host, int port);
         ~Client();
 
         bool connectToServer();
+
+        // Switch to typed binary messages (/framing message). Line replies carry
+        // no delimiter, so only framed replies split reliably; call it before
+        // the username and before listen().
+        bool useMessageFraming();
+
         void sendMessage(const std::string& msg);
         std::string receiveMessage();
         bool sendFile(const std::string& target, const std::string& filepath);
+
+        // What sendMessage() / sendFile() put on the wire (ahead of the file's
+        // bytes), in the current framing, for callers that send on their own
+        std::string encodeMessage(const std::string& msg) const;
+        std::string encodeFileHeader(const std::string& target, const std::string& filename, uint64_t size) const;
+
+        // Defaults print replies and save files as received_<filename>
+        void onMessage(MessageHandler handler) { message_handler = std::move(handler); }
+        void onFile(FileHandler handler) { file_handler = std::move(handler); }
+
+        // One recv(), then every complete reply it finished; false once the
+        // server is gone. A non-blocking socket with nothing to read returns true.
+        bool receive();
         void listen();
-        void receiveFile(const std::string& filename, int filesize);
+
         void setUsername(const std::string& name) { username = name; }
         std::string getUsername() const { return username; }
         int getSockFD() const { return sock_fd; }
+        uint64_t bytesReceived() const { return received_bytes; }
     private:
+        static constexpr size_t RECV_CHUNK = 64 * 1024;
+
+        bool sendAll(const char* data, size_t len);
+        bool parseMessages();
+        void parseLines();
+        void dispatch(MessageType type, std::string_view content);
+        void beginFile(std::string_view header);
+        size_t writeFile(std::string_view bytes);
+
         int sock_fd;
         std::string server_host;
         int server_port;
         sockaddr_in server_addr;
 
         std::string username;  // NEW: store client's name
+
+        bool framed = false;
+        ByteBuffer inbound;
+        uint64_t received_bytes = 0;
+        uint64_t chunk_left = 0;   // body bytes of the FILE_CHUNK being streamed
+
+        MessageHandler message_handler;
+        FileHandler file_handler;
+
+        // The file being received
+        std::string file_name;
+        uint64_t file_left = 0;
+        bool file_active = false;
+        std::ofstream file_out;
     };
 
 } // namespace ChatServer
@@ -2,14 +2,24 @@
 #define CONFIG_HPP
 
 #include <string>
+#include <vector>
 
 namespace ChatConfig {
 
     // Networking (defaults can be overridden via JSON)
     extern int SERVER_PORT;                // Default listening port
+    extern int WEBSOCKET_PORT;             // WebSocket listener for browsers (0 disables it)
     extern int MAX_EVENTS;                 // Max events epoll can handle at once
-    extern int BACKLOG;                    // Max queued connections
+    extern int BACKLOG;                    // listen() backlog: connections queued before accept
     extern int BUFFER_SIZE;                // Buffer size for read/write
+    extern int MAX_OUTBOUND_QUEUE;         // Bytes queued per client before it is dropped
+    extern bool EDGE_TRIGGERED;            // EPOLLET mode, draining sockets until EAGAIN
+    extern int MAX_READS_PER_EVENT;        // Edge-triggered fairness: reads per socket per pass
+    extern int MAX_ACCEPTS_PER_EVENT;      // Fairness: accepts per pass before serving other sockets
+    extern int WORKER_THREADS;             // Reactor shards (0 = one per hardware thread)
+    extern std::string IO_BACKEND;         // "epoll", "io_uring" or "auto" (io_uring if the kernel has it)
+    extern std::string GATEWAY_TOKEN;      // Secret for /gateway session multiplexing ("" disables it)
+    extern int GATEWAY_SESSION_WINDOW;     // Reply bytes in flight per gateway session before CREDIT
 
     // User constraints
     extern int MAX_USERNAME_LEN;
@@ -18,9 +28,28 @@ namespace ChatConfig {
     // Timeouts (ms)
     extern int EPOLL_TIMEOUT;              // epoll_wait timeout in ms
     extern int CLIENT_INACTIVITY_TIMEOUT;  // Client inactivity timeout (default 5 min)
+    extern int OFFLINE_RETENTION;          // Offline users stay in /list this long (-1 = forever)
+    extern int WRITE_STALL_TIMEOUT;        // Drop a client whose queued output makes no progress this long
+    extern int FILE_TRANSFER_TIMEOUT;      // Drop a sender whose relayed upload makes no progress this long
+    extern int HOUSEKEEPING_INTERVAL;      // Period of per-shard cleanup (idle buffers, presence eviction)
+
+    // Message history
+    extern int HISTORY_SIZE;               // Recent lines kept per channel (global room, each group; 0 disables)
+    extern int HISTORY_MEMORY_BUDGET;      // Bytes all history may use; the oldest lines go first past it
+    extern bool HISTORY_REPLAY_ON_LOGIN;   // Replay the global room and the user's groups after login
+    extern std::string STORE_DIR;          // Durable message store directory ("" disables it)
+    extern int STORE_SEGMENT_BYTES;        // Size of each store segment file
+    extern int STORE_MAX_SEGMENTS;         // Segments kept; the oldest is deleted past this (0 = keep all)
 
     // Logging
     extern std::string LOG_FILE;
+    extern int LOG_MAX_BYTES;              // Rotate once the file reaches this size
+    extern int LOG_MAX_FILES;              // Rotated files kept (LOG_FILE.1 .. .N)
+    extern int LOG_QUEUE_CAPACITY;         // Lines buffered before new ones are dropped
+
+    // Admin / metrics
+    extern std::string ADMIN_SOCKET;       // Unix socket serving stats ("" disables it)
+    extern std::vector<std::string> ADMIN_USERS;  // Usernames allowed to run /stats
 
     // Function to allow dynamic config (optional JSON/env load)
     void loadConfig(const std::string &filename);
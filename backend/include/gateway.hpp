@@ -0,0 +1,40 @@
+#ifndef GATEWAY_HPP
+#define GATEWAY_HPP
+
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+namespace ChatServer {
+
+    // Multiplexed gateway protocol: one trusted connection (after /gateway)
+    // carries the sessions of many users. Every frame, both ways, is
+    //   u32 payload length | u32 session | u8 op | u8 type | payload
+    // with integers big-endian. `type` is the MessageType of a reply (0 from
+    // the gateway). Session 0 is the gateway connection itself.
+    struct GatewayFrame {
+        enum Op : uint8_t {
+            OPEN = 1,        // gateway -> server: log `session` in as the payload username
+            DATA = 2,        // one line of the session's input, or one reply to it
+            CLOSE = 3,       // log the session out; server -> gateway: the server ended it
+            CREDIT = 4,      // gateway -> server: u32 more reply bytes it takes for the session
+            OPEN_MANY = 5,   // session 0: repeated u32 session | u16 length | username
+            CLOSE_MANY = 6   // session 0: repeated u32 session
+        };
+        static constexpr size_t HEADER_SIZE = 10;
+        static constexpr size_t MAX_PAYLOAD = 1 << 20;  // bulk frames included
+
+        uint32_t length = 0;
+        uint32_t session = 0;
+        uint8_t op = 0;
+        uint8_t type = 0;
+
+        static void encodeHeader(char* out, uint32_t length, uint32_t session, uint8_t op, uint8_t type = 0);
+
+        // Header at the start of buffer; false until HEADER_SIZE bytes are there
+        static bool decodeHeader(std::string_view buffer, GatewayFrame& out);
+    };
+
+} // namespace ChatServer
+
+#endif // GATEWAY_HPP
@@ -0,0 +1,64 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace ChatServer {
+
+    // Fixed-size log-linear histogram (HdrHistogram-style): each power of two
+    // is split into 16 linear sub-buckets, so any recorded value is reported
+    // within ~6%. Recording is a couple of shifts and an increment; not
+    // thread-safe, keep one per thread and merge().
+    class LatencyHistogram {
+    public:
+        void record(uint64_t value);
+        void merge(const LatencyHistogram& other);
+        void reset();
+
+        uint64_t count() const { return total; }
+        uint64_t sum() const { return value_sum; }
+        uint64_t max() const { return largest; }
+
+        // Upper bound of the bucket holding the p-th percentile (0 < p <= 100)
+        uint64_t percentile(double p) const;
+
+        // Recorded values in buckets that end at or below `value`
+        uint64_t countAtOrBelow(uint64_t value) const;
+
+    private:
+        friend class ConcurrentHistogram;
+
+        static constexpr int SUB_BITS = 4;
+        static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+        static constexpr int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+        std::array<uint64_t, BUCKETS> counts{};
+        uint64_t total = 0;
+        uint64_t value_sum = 0;
+        uint64_t largest = 0;
+
+        static int bucketOf(uint64_t value);
+        static uint64_t bucketCeiling(int bucket);
+    };
+
+    // Same buckets, written by one thread and readable from any other (a
+    // stats scrape) while it is being updated. Counts are relaxed atomics
+    // bumped with a plain load+store, so recording costs no locked instruction.
+    class ConcurrentHistogram {
+    public:
+        void record(uint64_t value);
+
+        // Add the current counts into `out`
+        void snapshotInto(LatencyHistogram& out) const;
+
+    private:
+        std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS> counts{};
+        std::atomic<uint64_t> value_sum{0};
+        std::atomic<uint64_t> largest{0};
+    };
+
+} // namespace ChatServer
+
+#endif // HISTOGRAM_HPP
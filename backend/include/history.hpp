@@ -0,0 +1,77 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include "buffer.hpp"
+
+namespace ChatServer {
+
+    // Recent lines per channel (the global room, and each group), kept in
+    // fixed-size rings so reconnecting users can catch up. Lines are the
+    // shared payloads already sent to recipients, so storing one copies
+    // nothing. Ring storage is carved from slabs, and slabs plus stored
+    // lines stay under one memory budget: past it, the oldest lines across
+    // all channels go first. A per-channel size of 0 keeps nothing.
+    // Thread-safe.
+    class HistoryStore {
+    public:
+        static constexpr uint32_t GLOBAL = 0;
+        static uint32_t channelOf(uint32_t group) { return group + 1; }
+
+        HistoryStore(size_t per_channel, size_t memory_budget);
+
+        void append(uint32_t channel, const SharedBuffer& line);
+
+        // Up to `count` most recent lines of `channel`, oldest first
+        void recent(uint32_t channel, size_t count, std::vector<SharedBuffer>& out) const;
+
+        size_t perChannel() const { return capacity; }
+
+    private:
+        static constexpr uint32_t NO_RING = UINT32_MAX;
+        static constexpr size_t RINGS_PER_SLAB = 64;
+
+        struct Entry {
+            SharedBuffer line;
+            uint64_t seq = 0;
+        };
+
+        // Lines [first, next) are stored; seq % capacity is the slot
+        struct Channel {
+            uint32_t ring = NO_RING;
+            uint64_t first = 0;
+            uint64_t next = 0;
+        };
+
+        // Every stored line in arrival order, for budget eviction; entries
+        // already overwritten by their ring are stale and skipped
+        struct Stamp {
+            uint32_t channel;
+            uint64_t seq;
+        };
+
+        size_t capacity;
+        size_t budget;
+        size_t line_bytes = 0;
+        size_t slab_bytes = 0;
+        size_t stored = 0;
+
+        mutable std::mutex mutex;
+        std::vector<Channel> channels;                // by channel id
+        std::vector<std::unique_ptr<Entry[]>> slabs;  // RINGS_PER_SLAB rings each
+        uint32_t rings = 0;
+        std::deque<Stamp> order;
+
+        Entry* ring(uint32_t index) const;
+        bool allocateRing(Channel& ch);
+        void dropOldest(Channel& ch);
+        void compactOrder();
+    };
+
+} // namespace ChatServer
+
+#endif // HISTORY_HPP
@@ -0,0 +1,74 @@
+#ifndef IO_BACKEND_HPP
+#define IO_BACKEND_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sys/epoll.h>   // interest and readiness use the EPOLL* bits
+#include <sys/uio.h>     // iovec
+
+namespace ChatServer {
+
+    struct IoEvent {
+        enum class Kind : uint8_t {
+            READY,     // fd is ready for `events`
+            ACCEPTED,  // the listening socket fd accepted `result` (acceptMultishot)
+            RECEIVED,  // `result` bytes at `data` arrived on fd (0: EOF, <0: -errno) (addStream)
+            SENT       // send() `tag` on fd finished: `result` bytes written, or -errno
+        };
+
+        Kind kind;
+        int fd;
+        uint32_t events = 0;
+        int result = 0;
+        const char* data = nullptr;   // valid until the next wait()
+        uint64_t tag = 0;
+    };
+
+    // How a reactor waits for sockets. The epoll backend only reports
+    // readiness; the io_uring backend can also accept, receive and send on
+    // the loop's behalf, and the requests made between two wait() calls
+    // reach the kernel in the one io_uring_enter() that waits. Neither is
+    // thread-safe; each shard owns one.
+    class IoBackend {
+    public:
+        virtual ~IoBackend() = default;
+        virtual const char* name() const = 0;
+
+        // Interest with epoll_ctl() semantics (EPOLLIN/OUT/RDHUP/ET/ONESHOT);
+        // modify() returns false if fd was never added
+        virtual void add(int fd, uint32_t events) = 0;
+        virtual bool modify(int fd, uint32_t events) = 0;
+        virtual void remove(int fd) = 0;
+
+        // A client socket. With completesReads() its input arrives as RECEIVED
+        // events (EPOLLIN in the interest meaning "keep receiving") instead of
+        // as EPOLLIN readiness.
+        virtual void addStream(int fd, uint32_t events) { add(fd, events); }
+        virtual bool completesReads() const { return false; }
+
+        // Accept on the loop's behalf, reporting ACCEPTED; false if unsupported
+        virtual bool acceptMultishot(int) { return false; }
+
+        // Asynchronous sendmsg(); the iovecs are copied, the bytes they point
+        // to must stay put until the SENT event
+        virtual bool sendsAsync() const { return false; }
+        virtual void send(int, uint64_t, const iovec*, size_t) {}
+
+        // Block up to timeout_ms (-1: forever) and append what happened
+        virtual void wait(std::vector<IoEvent>& events, int timeout_ms) = 0;
+    };
+
+    // "epoll", "io_uring", or "auto" (io_uring when the kernel allows it).
+    // Anything that can't be set up falls back to epoll.
+    std::unique_ptr<IoBackend> makeIoBackend(const std::string& name, size_t max_events, size_t buffer_size);
+
+#ifdef CHAT_HAVE_IO_URING
+    // Null when the kernel lacks io_uring or a feature it needs
+    std::unique_ptr<IoBackend> makeUringBackend(size_t max_events, size_t buffer_size);
+#endif
+
+} // namespace ChatServer
+
+#endif // IO_BACKEND_HPP
@@ -0,0 +1,65 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <string>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ChatServer {
+
+    // Asynchronous chat log. Reactor threads push lines into a bounded
+    // lock-free queue; a background thread writes them out in batches
+    // (one write() per batch) and rotates the file by size. When the queue
+    // is full the line is dropped and counted instead of blocking the loop.
+    class Logger {
+    public:
+        Logger(const std::string& path, size_t queue_capacity, size_t max_bytes, int max_files);
+        ~Logger();
+
+        // Never blocks; returns false (and counts a drop) if the queue is full
+        bool log(std::string line);
+
+        uint64_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+    private:
+        // Bounded MPMC ring (Vyukov); only the writer thread pops
+        struct Cell {
+            std::atomic<size_t> sequence;
+            std::string data;
+        };
+
+        std::unique_ptr<Cell[]> cells;
+        size_t mask;
+        alignas(64) std::atomic<size_t> enqueue_pos{0};
+        alignas(64) std::atomic<size_t> dequeue_pos{0};
+        alignas(64) std::atomic<uint64_t> dropped{0};
+
+        std::string path;
+        size_t max_bytes;
+        int max_files;
+        int fd = -1;
+        size_t file_bytes = 0;
+
+        std::atomic<bool> stopping{false};
+        std::thread writer;
+
+        // The writer sleeps on wake_ready when the queue is empty; log() only
+        // takes wake_mutex to wake it, never while it is busy
+        std::mutex wake_mutex;
+        std::condition_variable wake_ready;
+        std::atomic<bool> writer_idle{false};
+
+        bool tryPop(std::string& out);
+        bool hasPending() const;
+        void writerLoop();
+        void writeBatch(const std::string& batch);
+        void openFile();
+        void rotate();
+    };
+
+} // namespace ChatServer
+
+#endif // LOGGER_HPP
@@ -2,25 +2,91 @@
 #define MESSAGE_HPP
 
 #include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
 
 namespace ChatServer {
 
-    enum class MessageType {
-        TEXT,
+    enum class MessageType : uint8_t {
+        TEXT,         // chat line to everyone (the first one is the username)
         JOIN,
-        LEAVE
+        LEAVE,
+        PRIVATE,      // target = user
+        GROUP,        // target = group
+        FILE_HEADER,  // target = user, content = "<filename> <size>"; size raw bytes follow
+        FILE_CHUNK,   // file bytes (server -> receiver)
+        COMMAND,      // content = "<name> <args>", as typed after the '/'
+        ACK,          // server confirmation of a request
+        ERROR         // server error reply
     };
+    constexpr uint8_t MESSAGE_TYPE_COUNT = 10;
 
+    // Big-endian integer fields, shared by the binary formats (this one and
+    // the gateway's)
+    inline void putU16(char* out, uint16_t value) {
+        out[0] = (char)(value >> 8);
+        out[1] = (char)value;
+    }
+
+    inline void putU32(char* out, uint32_t value) {
+        out[0] = (char)(value >> 24);
+        out[1] = (char)(value >> 16);
+        out[2] = (char)(value >> 8);
+        out[3] = (char)value;
+    }
+
+    inline uint16_t getU16(const char* in) {
+        return (uint16_t)((uint8_t)in[0] << 8 | (uint8_t)in[1]);
+    }
+
+    inline uint32_t getU32(const char* in) {
+        return (uint32_t)(uint8_t)in[0] << 24 | (uint32_t)(uint8_t)in[1] << 16 |
+               (uint32_t)(uint8_t)in[2] << 8 | (uint32_t)(uint8_t)in[3];
+    }
+
+    // Binary wire form, integers big-endian:
+    //   u32 body length | u8 type | u16 sender length | u16 target length
+    //   | sender | target | content (rest of the body)
+    // Decoding yields views into the caller's buffer and encoding writes into
+    // the caller's; neither allocates.
     struct Message {
-        MessageType type;
-        std::string sender;
-        std::string content;
+        static constexpr size_t HEADER_SIZE = 9;
+        static constexpr size_t MAX_FIELD = UINT16_MAX;  // longest sender / target
+
+        enum class Decode {
+            OK,
+            INCOMPLETE,  // need more bytes
+            TOO_LARGE,   // body over the limit; frame_size says how much to skip
+            INVALID      // malformed frame; frame_size says how much to skip
+        };
 
-        // Serialize to string for sending
+        MessageType type = MessageType::TEXT;
+        std::string_view sender;
+        std::string_view target;
+        std::string_view content;
+
+        size_t encodedSize() const { return HEADER_SIZE + sender.size() + target.size() + content.size(); }
+
+        // Write encodedSize() bytes at out
+        void encodeTo(char* out) const;
+
+        // Append the encoded frame to out
+        void appendTo(std::string& out) const;
         std::string serialize() const;
 
-        // Deserialize from string
-        static Message deserialize(const std::string& raw);
+        // Parse the frame at the start of buffer; max_body caps sender + target +
+        // content. On OK the fields view buffer, so they live as long as its bytes do.
+        static Decode decode(std::string_view buffer, size_t max_body, Message& out, size_t& frame_size);
+
+        // Parse only the HEADER_SIZE bytes at the start of buffer, so a large
+        // body (a file chunk) can be consumed as it arrives
+        static Decode decodeHeader(std::string_view buffer, MessageType& type, size_t& sender_len,
+                                   size_t& target_len, size_t& content_len);
+
+        // Header of a frame whose fields follow separately (per-recipient
+        // framing of a shared payload)
+        static void encodeHeader(char* out, MessageType type, size_t sender_len, size_t target_len, size_t content_len);
     };
 
 } // namespace ChatServer
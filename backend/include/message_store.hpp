@@ -0,0 +1,107 @@
+#ifndef MESSAGE_STORE_HPP
+#define MESSAGE_STORE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+#include "buffer.hpp"
+
+namespace ChatServer {
+
+    // Durable chat history: binary records appended to fixed-size segment
+    // files (<dir>/<number>.seg). Every channel (the main room is "", groups
+    // by name) numbers its lines from 0, and an in-memory index maps each
+    // sequence number to its segment and offset. Appends are queued and a
+    // background thread writes them one batch per pwrite(); reads come
+    // straight out of the mmap'd segments. Retention drops whole segments,
+    // oldest first. The index is rebuilt at startup by walking record headers.
+    // Thread-safe.
+    class MessageStore {
+    public:
+        MessageStore(const std::string& dir, size_t segment_bytes, int max_segments);
+        ~MessageStore();
+
+        // Never waits on disk; the line is readable once its batch is written.
+        // False if it was dropped: larger than a segment, or the writer is a
+        // whole segment behind.
+        bool append(std::string_view channel, std::string_view line);
+
+        // Start `channel` over: lines appended before this are never served
+        // again, across restarts too. For a group name that is being reused.
+        void resetChannel(std::string_view channel);
+
+        // Up to `count` most recent written lines of `channel`, oldest first
+        void recent(std::string_view channel, size_t count, std::vector<SharedBuffer>& out) const;
+
+        // Fixed layout at the start of every record, followed by the channel
+        // name and the line, padded to 8 bytes
+        struct RecordHeader {
+            uint32_t magic;
+            uint32_t length;        // channel name + line
+            uint64_t seq;           // within the channel
+            int64_t time_ms;        // wall clock at append
+            uint16_t channel_len;
+            uint8_t flags;          // RECORD_RESET: no line, the channel starts over
+            uint8_t reserved[5];
+        };
+
+    private:
+        struct Segment {
+            uint32_t number;
+            int fd;
+            const char* map;
+            size_t size;
+            size_t used;            // written bytes; only the writer thread moves it
+        };
+
+        struct Location {
+            uint32_t segment;       // Segment::number
+            uint32_t offset;
+        };
+
+        // Written lines [first_seq, first_seq + locations.size())
+        struct ChannelIndex {
+            uint64_t first_seq = 0;
+            std::deque<Location> locations;
+        };
+
+        std::string dir;
+        size_t segment_bytes;
+        int max_segments;
+
+        // Read side: segments and index
+        mutable std::shared_mutex mutex;
+        std::deque<Segment> segments;
+        std::unordered_map<std::string, ChannelIndex> channels;
+
+        // Write side: records waiting for the writer, and the next seq per channel
+        std::mutex queue_mutex;
+        std::condition_variable queue_ready;
+        std::string pending;
+        std::unordered_map<std::string, uint64_t> next_seq;
+        bool stopping = false;
+        std::thread writer;
+
+        static size_t recordSize(const RecordHeader& header);
+        bool enqueue(std::string_view channel, std::string_view line, uint8_t flags);
+        void recover();
+        void scanSegment(Segment& segment);
+        std::string segmentPath(uint32_t number) const;
+        void indexRecord(const Segment& segment, size_t offset);
+        Segment openSegment(uint32_t number);
+        void rollSegment();
+        void dropOldestSegment();
+        void writerLoop();
+        void writeBatch(const std::string& batch);
+    };
+
+} // namespace ChatServer
+
+#endif // MESSAGE_STORE_HPP
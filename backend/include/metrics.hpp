@@ -0,0 +1,93 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "histogram.hpp"
+
+namespace ChatServer {
+
+    class Logger;
+
+    // Monotonic count owned by one shard: only its thread writes, so a relaxed
+    // load+store does (no locked instruction); any thread may read
+    class Counter {
+    public:
+        void add(uint64_t n = 1) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+        uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value{0};
+    };
+
+    // Point-in-time level (connections, queued bytes). add() is single-writer
+    // like Counter; set() may come from any thread.
+    class Gauge {
+    public:
+        void add(int64_t delta) { value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed); }
+        void set(int64_t level) { value.store(level, std::memory_order_relaxed); }
+        int64_t get() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<int64_t> value{0};
+    };
+
+    // Everything one reactor shard records. Handler slots follow the order of
+    // the names given to Metrics (command table, then chat and login).
+    struct ShardMetrics {
+        explicit ShardMetrics(size_t handler_count)
+            : handled(handler_count), handler_latency(handler_count) {}
+
+        std::vector<Counter> handled;
+        std::vector<ConcurrentHistogram> handler_latency;  // ns
+        ConcurrentHistogram loop_iteration;                // ns per epoll pass with events
+        Counter bytes_in;
+        Counter bytes_out;
+        Counter accepted;
+        Counter store_dropped;    // chat lines the message store refused
+        Gauge connected;
+        Gauge outbound_bytes;     // in-memory bytes waiting in outbound queues
+        Gauge mailbox_depth;      // envelopes posted but not yet drained
+    };
+
+    // Per-shard metrics plus the Prometheus text rendering of all of them
+    class Metrics {
+    public:
+        Metrics(size_t shard_count, std::vector<std::string> handler_names, const Logger& logger);
+
+        ShardMetrics& shard(int index) { return *shards[index]; }
+
+        // Prometheus text exposition format (version 0.0.4)
+        std::string render() const;
+
+    private:
+        std::vector<std::string> handler_names;
+        std::vector<std::unique_ptr<ShardMetrics>> shards;
+        const Logger& logger;
+    };
+
+    // Unix-domain admin socket. Each connection gets one snapshot and is
+    // closed; an HTTP GET (curl --unix-socket) gets it with an HTTP header.
+    // Served from its own thread, away from the reactors.
+    class StatsSocket {
+    public:
+        StatsSocket(const std::string& path, const Metrics& metrics);
+        ~StatsSocket();
+
+    private:
+        std::string path;
+        const Metrics& metrics;
+        int listen_fd;
+        std::atomic<bool> stopping{false};
+        std::thread server;
+
+        void serve();
+        void answer(int client_fd);
+    };
+
+} // namespace ChatServer
+
+#endif // METRICS_HPP
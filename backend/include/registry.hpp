@@ -0,0 +1,152 @@
+#ifndef REGISTRY_HPP
+#define REGISTRY_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include "buffer.hpp"
+
+namespace ChatServer {
+
+    class Server;
+
+    // Dense ids, one per name while the user is online, listed by /list or in
+    // a group; after that the name is forgotten and its id reused
+    using UserId = uint32_t;
+    using GroupId = uint32_t;
+    constexpr UserId NO_USER = UINT32_MAX;
+
+    // Where a logged-in user's connection lives (shard index + fd on that shard)
+    struct UserLocation {
+        int shard;
+        int fd;
+    };
+
+    // An online user as seen by routing code
+    struct Route {
+        UserId user;
+        UserLocation loc;
+    };
+
+    // Immutable recipient list, shared by every sender until membership or
+    // presence changes
+    using RouteList = std::shared_ptr<const std::vector<Route>>;
+
+    enum class GroupStatus {
+        OK,
+        EXISTS,
+        NO_GROUP,
+        NOT_ADMIN,
+        NOT_MEMBER
+    };
+
+    // State shared by every reactor shard: who is online where, and the groups.
+    // Usernames are interned to UserIds at login; everything past that point
+    // (presence, membership, routing) works on ids. All methods are thread-safe.
+    class Registry {
+    public:
+        explicit Registry(size_t shard_count);
+
+        void attachShard(int index, Server* shard);
+        Server* shard(int index) const { return shards[index]; }
+        size_t shardCount() const { return shards.size(); }
+
+        // Presence. login() interns the name into `user` and returns the
+        // previous location if the user was already online.
+        std::optional<UserLocation> login(const std::string& username, UserLocation loc, UserId& user);
+        void logout(UserId user, UserLocation loc);
+        std::optional<Route> find(const std::string& username) const;
+
+        // Rendered "Online users" text, rebuilt only after presence changes
+        SharedBuffer onlineList();
+        void evictOfflineNow();  // housekeeping; onlineList() also evicts as it goes
+
+        // Groups
+        GroupStatus createGroup(const std::string& group, UserId creator);
+        GroupStatus addMember(const std::string& group, UserId admin, const std::string& user);
+        GroupStatus kickMember(const std::string& group, UserId admin, const std::string& user);
+        std::string renderGroupsOf(UserId user) const;  // walks only the user's own groups
+
+        // Online members of `group` (sender included), if sender is a member.
+        // A snapshot of the group's online list: taking it holds the shared
+        // lock only for a reference count, and the fan-out walks it unlocked.
+        GroupStatus groupRecipients(const std::string& group, UserId sender, RouteList& out, GroupId& id) const;
+
+        // Id of `group`, if `member` belongs to it
+        GroupStatus memberGroup(const std::string& group, UserId member, GroupId& id) const;
+
+        // Id and name of every group the user is in
+        std::vector<std::pair<GroupId, std::string>> groupsOf(UserId user) const;
+
+    private:
+        static constexpr uint32_t NOT_LISTED = UINT32_MAX;
+
+        struct UserRecord {
+            std::string name;
+            bool online = false;
+            UserLocation loc{-1, -1};
+            uint32_t presence = NOT_LISTED;  // slot in presence, while listed by /list
+            std::vector<GroupId> groups;     // sorted; reverse index of Group::members
+            std::vector<uint32_t> online_slots;  // per entry of groups: index in its online list
+        };
+
+        enum class PresenceState : uint8_t { ONLINE, OFFLINE };
+
+        // One /list entry; offline ones are evicted after OFFLINE_RETENTION
+        struct Presence {
+            UserId user;
+            PresenceState state;
+            time_t since;
+        };
+
+        struct OfflineEntry {
+            UserId user;
+            time_t since;
+        };
+
+        struct Group {
+            std::string name;
+            std::vector<UserId> members;  // sorted
+            std::vector<UserId> admins;   // sorted
+            std::vector<Route> online;    // online members, packed
+            // Copy of online handed to senders; built on first use under the
+            // shared lock (hence atomic access), dropped whenever online changes
+            mutable RouteList online_view;
+        };
+
+        std::vector<Server*> shards;
+
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, UserId> user_ids;
+        std::vector<UserRecord> users;                   // indexed by UserId
+        std::vector<UserId> free_users;                  // reclaimed ids, reused first
+        std::unordered_map<std::string, GroupId> group_ids;
+        std::vector<Group> groups;                       // indexed by GroupId
+
+        std::vector<Presence> presence;           // packed, in no particular order
+        std::deque<OfflineEntry> offline_queue;    // logouts, oldest first (may be stale)
+        SharedBuffer list_cache;                   // null when presence changed since rendering
+        time_t list_expires = 0;                   // first offline entry due for eviction
+
+        UserId internLocked(const std::string& username);
+        std::optional<UserId> lookupLocked(const std::string& username) const;
+        void reclaimIfUnused(UserId user);
+        void setPresence(UserId user, PresenceState state, time_t now);
+        void evictOffline(time_t now);
+        void linkMember(GroupId group, UserId user);
+        void unlinkMember(GroupId group, UserId user);
+        void joinOnline(UserId user, size_t index);   // index into the user's groups
+        void leaveOnline(UserId user, size_t index);
+        static void onlineChanged(Group& grp) { std::atomic_store(&grp.online_view, RouteList()); }
+    };
+
+} // namespace ChatServer
+
+#endif // REGISTRY_HPP
@@ -2,52 +2,325 @@
 #define SERVER_HPP
 
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <string_view>
+#include <chrono>
 #include <netinet/in.h>   // sockaddr_in
 #include <sys/epoll.h>    // epoll
 #include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <deque>
+#include "registry.hpp"
+#include "buffer.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "message.hpp"
+#include "websocket.hpp"
+#include "gateway.hpp"
+#include "timer_wheel.hpp"
+#include "history.hpp"
+#include "message_store.hpp"
+#include "io_backend.hpp"
 
 namespace ChatServer {
 
+    // How a connection delimits frames, both ways
+    enum class Framing {
+        LINE,     // '\n'-terminated text lines in; replies go out as-is (chat_client, bridge.js)
+        LENGTH,   // 4-byte big-endian length prefix, then payload
+        MESSAGE,  // binary Message frames (message.hpp)
+        WEBSOCKET,// RFC 6455 frames; inbound is unwrapped to LINE text before parsing
+        GATEWAY   // multiplexed sessions (gateway.hpp); replies carry their session id
+    };
+
+    // Work handed to a shard by another shard's thread
+    struct Envelope {
+        enum class Kind {
+            DELIVER,    // send payload to fd (if it still belongs to user)
+            BROADCAST,  // send payload to every local client
+            KICK,       // send payload to fd, then disconnect it
+            STREAM      // queue file_size bytes of file to fd (if it still belongs to user)
+        };
+
+        Kind kind;
+        int fd;
+        UserId user;
+        SharedBuffer payload;
+        SharedFile file = nullptr;
+        uint64_t file_size = 0;
+        MessageType type = MessageType::TEXT;  // frame type for MESSAGE-framed receivers
+    };
+
+    // A relayed /sendfile upload in progress on the sender's connection. Bytes
+    // move sender socket -> pipe -> receiver socket with splice(); the
+    // receiver's outbound queue holds the read end and drains it at its own pace.
+    struct Upload {
+        SharedFile pipe_in;        // write end
+        uint64_t remaining;        // bytes still expected from the sender
+        Route target;
+        std::string target_name;
+        std::string filename;
+    };
+
+    // A browser connection accepted on the WebSocket port. Its frames are
+    // unwrapped into Connection::inbound, so commands are parsed as for TCP clients.
+    struct WebSocketState {
+        ByteBuffer raw;                // bytes as received: the HTTP request, then frames
+        bool open = false;             // upgrade handshake done
+        bool in_message = false;       // a fragmented message awaits continuation frames
+        bool text = false;             // the current message is text ('\n'-terminated in inbound)
+        bool final_frame = false;      // the frame being unwrapped ends its message
+        uint64_t payload_left = 0;     // bytes of that frame still to unwrap
+        uint64_t payload_offset = 0;   // bytes of it unwrapped so far (mask position)
+        std::array<uint8_t, 4> mask{};
+    };
+
+    // One line of a multi-line reply sent with Server::sendBatch()
+    struct BatchLine {
+        SharedBuffer payload;
+        MessageType type;
+    };
+
+    // A connection that switched to /gateway: the sessions it carries
+    struct Gateway {
+        std::unordered_map<uint32_t, int> sessions;  // wire session id -> session slot
+    };
+
+    // A user multiplexed over a gateway connection. Replies go out on the
+    // gateway's socket as long as the session has credit and wait here otherwise.
+    struct Session {
+        int gateway_fd;
+        uint32_t id;                   // the gateway's id for it, on the wire
+        int64_t credit;                // reply bytes the gateway still takes for it
+        std::deque<BatchLine> held;    // replies waiting for CREDIT
+        size_t held_bytes = 0;
+        bool kicked = false;           // fell too far behind; being closed
+    };
+
+    // Per-socket state owned by a shard, stored in a slot indexed by fd
+    // (or, for a gateway session, by Server::SESSION_BASE + index)
+    struct Connection {
+        bool open = false;             // slot holds a live socket
+        size_t live_index = 0;         // position in Server::live_fds
+        UserId user_id = NO_USER;      // interned at login
+        std::string username;          // empty until the first frame arrives
+        Framing framing = Framing::LINE;
+        ByteBuffer inbound;            // bytes read but not yet parsed into frames
+        size_t skip_bytes = 0;         // rest of an oversized LENGTH frame to discard
+        bool skip_line = false;        // discard up to the next '\n' (oversized LINE)
+        OutboundQueue outbound;        // shared payloads send() could not take yet
+        bool write_armed = false;      // EPOLLOUT currently registered
+        uint64_t send_tag = 0;         // asynchronous send in flight (io_uring), 0 if none
+        bool read_paused = false;      // EPOLLIN dropped while an upload's pipe is full
+        bool read_pending = false;     // queued in pending_reads (edge-triggered)
+        std::unique_ptr<Upload> upload;  // set while the socket feeds a relay pipe
+        std::unique_ptr<WebSocketState> ws;  // set for connections on the WebSocket port
+        std::unique_ptr<Gateway> gateway;    // set once the connection switched to /gateway
+        std::unique_ptr<Session> session;    // set for a session slot, which has no socket
+
+        // Timers re-check state when they fire rather than being moved on every
+        // event, so reads and writes never touch the wheel
+        uint64_t last_active = 0;        // tick of the last read
+        TimerId idle_timer = NO_TIMER;
+        uint64_t idle_mark = 0;          // outbound.sentTotal() when the idle timer last fired
+        TimerId stall_timer = NO_TIMER;  // while output waits on EPOLLOUT
+        uint64_t stall_mark = 0;         // outbound.sentTotal() when last checked
+        TimerId upload_timer = NO_TIMER; // while an upload is in progress
+        uint64_t upload_mark = 0;        // upload->remaining when last checked
+    };
+
+    enum class TimerKind {
+        IDLE,          // CLIENT_INACTIVITY_TIMEOUT with nothing read or sent
+        WRITE_STALL,   // queued output made no progress for WRITE_STALL_TIMEOUT
+        UPLOAD,        // relayed upload made no progress for FILE_TRANSFER_TIMEOUT
+        HOUSEKEEPING   // periodic, not tied to a connection
+    };
+
+    // One reactor: owns a listening socket (SO_REUSEPORT), an I/O backend
+    // (epoll or io_uring) and the connections accepted on it. Runs on its own thread.
     class Server {
     public:
-        Server();
+        Server(int shard_index, Registry& registry, Logger& logger, Metrics& metrics,
+               HistoryStore& history, MessageStore* store);
         ~Server();
 
-        // Start the server loop
+        // Start the server loop; returns once stop() was called
         void run();
 
+        // Make run() return. Async-signal-safe: a flag and an eventfd write.
+        void stop();
+
+        // Queue work from another shard and wake this shard's loop
+        void post(Envelope env);
+
+        // Command table lookup; public so chat_microbench can time it
+        using CommandHandler = void (Server::*)(int client_fd, const std::string& sender, std::string_view args);
+        struct Command {
+            std::string_view name;
+            CommandHandler handler;
+            bool before_login;  // usable before the username is set
+        };
+        static constexpr size_t COMMAND_COUNT = 14;
+        static const Command* findCommand(std::string_view name);
+        static const Command& command(size_t index);  // table order, sorted by name
+
+        // Metrics slots: one per command (table order), then plain chat and login
+        static constexpr size_t HANDLER_CHAT = COMMAND_COUNT;
+        static constexpr size_t HANDLER_LOGIN = COMMAND_COUNT + 1;
+        static constexpr size_t HANDLER_COUNT = COMMAND_COUNT + 2;
+        static std::vector<std::string> handlerNames();
+
     private:
+        struct CommandTable {
+            const Command* rows;
+            std::array<uint8_t, 27> buckets;  // first row of each letter 'a'..'z', then the end
+        };
+        static const CommandTable& commandTable();
+
+        int shard_index;
+        Registry& registry;
+        Logger& logger;
+        const Metrics& metrics;   // whole-process view, for /stats
+        ShardMetrics& stats;      // this shard's counters
+        HistoryStore& history;    // recent lines of the global room and groups, shared
+        MessageStore* store;      // durable chat history; null when store_dir is ""
+
+        bool edge_triggered;       // EPOLLET: drain until EAGAIN under a budget
+        uint32_t client_events;    // base epoll mask for client sockets
+        bool completion_reads = false;   // input arrives as RECEIVED events (io_uring), not read()
+        std::vector<int> pending_reads;  // sockets that ran out of read budget
+        bool accept_pending = false;     // listening socket ran out of accept budget
+        std::string frame_scratch;       // reused frame storage for nextFrame()
+        std::vector<SharedBuffer> history_scratch;  // reused for history lookups
+        std::vector<BatchLine> batch_scratch;       // reused reply for /history and replay
+
+        // Rate limit for connection and store-drop lines (consoleAllowed())
+        static constexpr int CONSOLE_LINES_PER_SECOND = 20;
+        uint64_t console_window = 0;     // tick the current one-second window began
+        int console_lines = 0;
+        uint64_t console_suppressed = 0;
+
         int server_fd;     // listening socket
-        int epoll_fd;      // epoll instance
-        sockaddr_in addr;  // server address
+        int ws_fd = -1;    // WebSocket listening socket, -1 when disabled
+        std::unique_ptr<IoBackend> io;
+        int wake_fd;       // eventfd signalled when the mailbox is non-empty (or on stop())
+        std::atomic<bool> stopping{false};
+        int timer_fd;      // periodic timerfd driving the timer wheel
+
+        // Connection slots indexed by fd (the kernel hands out the lowest free
+        // fd, so this stays dense), plus the open fds packed for fan-out
+        std::vector<Connection> connections;
+        std::vector<int> live_fds;
 
-        // Map client socket -> username (for message routing)
-        std::unordered_map<int, std::string> clients;
-        std::unordered_map<std::string, int> username_fd_map;
-        std::unordered_map<std::string, std::string> user_status_map; // username -> status string
+        // Gateway sessions, addressed as SESSION_BASE + index wherever a
+        // client fd is expected (routes, timers, envelopes); live_fds has them too
+        static constexpr int SESSION_BASE = 1 << 30;
+        std::vector<Connection> sessions;
+        std::vector<int> free_sessions;
 
-        // group_name -> set of usernames
-        std::unordered_map<std::string, std::unordered_set<std::string>> groups;
+        // Relay pipe end (by fd) -> client fd waiting for it to become ready
+        std::vector<int> pipe_owner;
 
-        // group_name -> set of admin usernames
-        std::unordered_map<std::string, std::unordered_set<std::string>> group_admins;
+        // Asynchronous sends: the last tag handed out, and the queues of closed
+        // connections whose send the kernel may still be reading
+        uint64_t last_send_tag = 0;
+        std::unordered_map<uint64_t, OutboundQueue> orphaned_sends;
+
+        TimerWheel timers;
+        std::vector<ExpiredTimer> expired_timers;
+
+        std::mutex mailbox_mutex;
+        std::vector<Envelope> mailbox;
 
-        std::unordered_map<std::string, std::unordered_set<std::string>> group_members;
         // Setup
         void initServerSocket();
-        void initEpoll();
+        int openListener(int port);
+        void initBackend();
 
         // Event handling
-        void handleNewConnection();
-        void handleClientMessage(int client_fd);
+        void handleNewConnection(int listen_fd);
+        void acceptConnection(int client_fd, bool websocket = false);
+        bool consoleAllowed();
+        void rollConsoleWindow();
+        void handleClientInput(int client_fd);
+        void handleReceived(int client_fd, const char* data, int result);
+        void handleInbound(int client_fd);
+        bool unwrapWebSocket(int client_fd);
+        void closeWebSocket(int client_fd, std::string_view status);
+        bool nextGatewayFrame(int client_fd, Connection& conn, GatewayFrame& frame, std::string_view& payload);
+        void handleGatewayFrame(int client_fd, const GatewayFrame& frame, std::string_view payload);
+        void openSession(int gateway_fd, uint32_t id, std::string_view username);
+        void closeSession(int gateway_fd, uint32_t id);
+        void handleFrames(int client_fd);
+        bool nextFrame(int client_fd, Connection& conn, std::string& frame);
+        bool nextMessage(int client_fd, Connection& conn, Message& message);
+        void handleClientMessage(int client_fd, std::string_view msg);
+        void handleMessage(int client_fd, const Message& message);
+        bool runCommand(int client_fd, std::string_view name, std::string_view args);
+        void handleText(int client_fd, std::string_view msg);
+        void handleLogin(int client_fd, const std::string& new_username);
+        void recordHandler(size_t handler, std::chrono::steady_clock::time_point start);
         void removeClient(int client_fd);
+        void drainMailbox();
+        void flushOutbound(int client_fd);
+        void handleSendDone(int client_fd, uint64_t tag, int result);
+        void setWriteInterest(int client_fd, bool enabled, bool rearm = false);
+        void setReadInterest(int client_fd, bool enabled);
+        void applyInterest(int client_fd, const Connection& conn);
+        bool pumpUpload(int client_fd);
+        void watchPipe(int pipe_fd, uint32_t events, int client_fd);
+        void handlePipeReady(int pipe_fd);
+        Connection* findConnection(int client_fd);
+        Connection& connectionOf(int client_fd);  // for ids known to be open
+        void unlistLive(Connection& conn);
+
+        // Timers
+        void handleTimers();
+        bool claimTimer(const ExpiredTimer& timer);
+        void onTimer(const ExpiredTimer& timer);
+        void housekeeping();
+        void armTimer(TimerId& slot, int client_fd, TimerKind kind, int timeout_ms);
+
+        // Commands: "/name args" is looked up in a static table and routed to a handler
+        void cmdHelp(int client_fd, const std::string& sender, std::string_view args);
+        void cmdWhoami(int client_fd, const std::string& sender, std::string_view args);
+        void cmdList(int client_fd, const std::string& sender, std::string_view args);
+        void cmdPrivateMessage(int client_fd, const std::string& sender, std::string_view args);
+        void cmdCreateGroup(int client_fd, const std::string& sender, std::string_view args);
+        void cmdAddMember(int client_fd, const std::string& sender, std::string_view args);
+        void cmdKickMember(int client_fd, const std::string& sender, std::string_view args);
+        void cmdListGroups(int client_fd, const std::string& sender, std::string_view args);
+        void cmdGroupMessage(int client_fd, const std::string& sender, std::string_view args);
+        void cmdSendFile(int client_fd, const std::string& sender, std::string_view args);
+        void cmdFraming(int client_fd, const std::string& sender, std::string_view args);
+        void cmdGateway(int client_fd, const std::string& sender, std::string_view args);
+        void cmdStats(int client_fd, const std::string& sender, std::string_view args);
+        void cmdHistory(int client_fd, const std::string& sender, std::string_view args);
+        void privateMessage(int client_fd, const std::string& sender, std::string_view target, std::string_view text);
+        void groupMessage(int client_fd, const std::string& sender, std::string_view group, std::string_view text);
+        void batchHistory(uint32_t channel, std::string_view stored_channel, size_t count,
+                          const std::string& title, MessageType type);
+        void replayHistory(int client_fd, UserId user);
 
         // Utility
-        void broadcastMessage(const std::string& msg, int exclude_fd = -1);
-        void sendMessage(int client_fd, const std::string& msg);
+        void broadcastMessage(const SharedBuffer& payload, int exclude_fd = -1);
+        void sendMessage(int client_fd, std::string msg, MessageType type = MessageType::TEXT);
+        void sendError(int client_fd, std::string msg);
+        void sendBuffer(int client_fd, const SharedBuffer& payload, MessageType type = MessageType::TEXT);
+        void sendBatch(int client_fd, const std::vector<BatchLine>& lines);
+        void sendRaw(int client_fd, const SharedBuffer& bytes);
+        void sendControl(int client_fd, uint8_t opcode, std::string_view payload);
+        void sendToSession(int session_fd, Connection& conn, const SharedBuffer& payload, MessageType type);
+        void releaseHeld(Connection& conn);
+        void deliver(const Route& route, std::string msg, MessageType type = MessageType::TEXT);
+        void deliverBuffer(const Route& route, const SharedBuffer& payload, MessageType type = MessageType::TEXT);
+        void sendFile(int client_fd, const SharedFile& file, uint64_t size);
+        void deliverFile(const Route& route, const SharedFile& file, uint64_t size);
         void logMessage(const std::string& msg);
+        void recordChat(std::string_view channel, const std::string& line);
     };
 
 } // namespace ChatServer
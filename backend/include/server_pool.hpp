@@ -0,0 +1,41 @@
+#ifndef SERVER_POOL_HPP
+#define SERVER_POOL_HPP
+
+#include <memory>
+#include <vector>
+#include "registry.hpp"
+#include "logger.hpp"
+#include "server.hpp"
+#include "metrics.hpp"
+#include "history.hpp"
+#include "message_store.hpp"
+
+namespace ChatServer {
+
+    // Multi-reactor front: one Server shard per worker thread, all sharing
+    // the listening port, a common Registry and the message history.
+    class ServerPool {
+    public:
+        explicit ServerPool(int worker_threads);
+
+        // Run every shard; blocks the calling thread (it drives shard 0)
+        // until stop(), then waits for the other shards
+        void run();
+
+        // Ask every shard to return from run(); async-signal-safe. The pool's
+        // destructor then flushes the message store and the log.
+        void stop();
+
+    private:
+        std::unique_ptr<Logger> logger;
+        std::unique_ptr<Metrics> metrics;
+        std::unique_ptr<StatsSocket> stats_socket;  // null when admin_socket is ""
+        std::unique_ptr<Registry> registry;
+        std::unique_ptr<HistoryStore> history;
+        std::unique_ptr<MessageStore> store;        // null when store_dir is ""
+        std::vector<std::unique_ptr<Server>> shards;
+    };
+
+} // namespace ChatServer
+
+#endif // SERVER_POOL_HPP
@@ -0,0 +1,70 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ChatServer {
+
+    using TimerId = uint32_t;
+    constexpr TimerId NO_TIMER = UINT32_MAX;
+
+    struct ExpiredTimer {
+        TimerId id;
+        int owner;
+        int kind;
+    };
+
+    // Hierarchical timing wheel (Varghese & Lauck): 4 levels of 64 slots, so
+    // level L holds timers due within 64^(L+1) ticks and is cascaded down one
+    // level each time the level below wraps. Schedule and cancel are O(1);
+    // advancing costs O(1) per tick plus O(1) per expired or cascaded timer.
+    // Nodes live in a pool addressed by index, so owners may move in memory.
+    // Not thread-safe: one wheel per reactor.
+    class TimerWheel {
+    public:
+        static constexpr uint64_t MAX_DELAY = (1ull << 24) - 1;  // ticks; longer delays are clamped
+
+        explicit TimerWheel(uint64_t now = 0) : current(now) { heads.fill(NO_TIMER); }
+
+        // Fire `delay` ticks from now (at least one); owner/kind come back on expiry
+        TimerId schedule(uint64_t delay, int owner, int kind);
+        void cancel(TimerId id);
+
+        // Move time forward to `now`, appending every timer that came due. Their
+        // ids are released: owners must forget them before scheduling again.
+        void advance(uint64_t now, std::vector<ExpiredTimer>& expired);
+
+        uint64_t now() const { return current; }
+        size_t size() const { return active; }
+
+    private:
+        static constexpr int LEVEL_BITS = 6;
+        static constexpr int SLOTS = 1 << LEVEL_BITS;
+        static constexpr int LEVELS = 4;
+
+        struct Node {
+            uint32_t prev;
+            uint32_t next;
+            uint32_t slot;      // index into heads while linked
+            uint64_t expires;   // absolute tick
+            int owner;
+            int kind;
+        };
+
+        std::vector<Node> nodes;
+        std::array<uint32_t, LEVELS * SLOTS> heads;
+        uint32_t free_head = NO_TIMER;
+        uint64_t current;
+        size_t active = 0;
+
+        void link(TimerId id);
+        void unlink(TimerId id);
+        void cascade(int level);
+    };
+
+} // namespace ChatServer
+
+#endif // TIMER_WHEEL_HPP
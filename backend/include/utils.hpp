@@ -2,11 +2,18 @@
 #define UTILS_HPP
 
 #include <string>
+#include <string_view>
+#include <utility>
 #include <chrono>
 
 namespace ChatServer {
     std::string currentTimestamp();
     std::string trim(const std::string& str);
+
+    // Non-allocating variants for the command path
+    std::string_view trimView(std::string_view str);
+    // Split off the first space-delimited token; the rest comes back trimmed
+    std::pair<std::string_view, std::string_view> splitToken(std::string_view str);
 }
 
 #endif // UTILS_HPP
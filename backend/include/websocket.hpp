@@ -0,0 +1,63 @@
+#ifndef WEBSOCKET_HPP
+#define WEBSOCKET_HPP
+
+#include <string>
+#include <string_view>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ChatServer {
+
+    // RFC 6455 pieces the server needs: the opening handshake and frame
+    // headers. Clients mask every frame they send; the server never masks.
+    struct WebSocketFrame {
+        enum Opcode : uint8_t {
+            CONTINUATION = 0x0,
+            TEXT = 0x1,
+            BINARY = 0x2,
+            CLOSE = 0x8,
+            PING = 0x9,
+            PONG = 0xA
+        };
+        static constexpr size_t MAX_SERVER_HEADER = 10;  // 2 bytes + 64-bit length
+        static constexpr size_t MAX_CONTROL = 125;       // control frame payload limit
+
+        enum class Decode {
+            OK,
+            INCOMPLETE,  // need more bytes
+            INVALID      // protocol error; the connection must be failed
+        };
+
+        bool fin = false;
+        uint8_t opcode = 0;
+        uint64_t length = 0;                // payload bytes after the header
+        std::array<uint8_t, 4> mask{};
+        size_t header_size = 0;
+
+        bool isControl() const { return opcode & 0x8; }
+
+        // Parse a client frame header at the start of buffer. Unmasked frames,
+        // reserved bits and oversized or fragmented control frames are INVALID.
+        static Decode decodeHeader(std::string_view buffer, WebSocketFrame& out);
+
+        // Write a server frame header (FIN set) for `length` payload bytes; returns its size
+        static size_t encodeHeader(char* out, uint8_t opcode, uint64_t length);
+
+        // XOR len bytes in place with mask, starting `offset` bytes into the payload
+        static void unmask(char* data, size_t len, const std::array<uint8_t, 4>& mask, uint64_t offset);
+    };
+
+    // Opening handshake: an HTTP/1.1 GET with "Upgrade: websocket". On OK,
+    // `key` views its Sec-WebSocket-Key and request_size is the request length.
+    WebSocketFrame::Decode parseUpgradeRequest(std::string_view buffer, std::string_view& key, size_t& request_size);
+
+    // The complete "101 Switching Protocols" reply for a Sec-WebSocket-Key
+    std::string upgradeResponse(std::string_view key);
+
+    // Sent before closing on a request that isn't a WebSocket upgrade
+    extern const char* const UPGRADE_REJECTED;
+
+} // namespace ChatServer
+
+#endif // WEBSOCKET_HPP
@@ -0,0 +1,312 @@
+#include "bench.hpp"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace ChatServer {
+
+// Largest burst a worker issues per loop pass when it falls behind schedule
+static constexpr uint64_t MAX_ISSUE_PER_PASS = 1024;
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool startsWith(std::string_view s, std::string_view prefix) {
+    return s.substr(0, prefix.size()) == prefix;
+}
+
+static uint64_t parseStamp(std::string_view digits) {
+    uint64_t value = 0;
+    std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    return value;
+}
+
+// Send timestamp carried in the message body as " @t<ns>"
+static uint64_t stampOf(std::string_view frame) {
+    size_t at = frame.rfind(" @t");
+    if (at == std::string_view::npos) return 0;
+    return parseStamp(frame.substr(at + 3));
+}
+
+void BenchStats::merge(const BenchStats& other) {
+    for (size_t i = 0; i < BENCH_OPS; ++i) {
+        latency[i].merge(other.latency[i]);
+        sent[i] += other.sent[i];
+    }
+    frames_received += other.frames_received;
+    bytes_received += other.bytes_received;
+    errors += other.errors;
+}
+
+BenchWorker::BenchWorker(const BenchOptions& options, BenchShared& shared, int first_client, int client_count)
+    : options(options), shared(shared), first_client(first_client), client_count(client_count),
+      rng(std::random_device{}() ^ first_client), file_payload(options.file_size, 'x') {
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1) { perror("epoll_create1"); exit(EXIT_FAILURE); }
+}
+
+BenchWorker::~BenchWorker() {
+    close(epoll_fd);
+}
+
+std::string BenchWorker::userName(int id) const {
+    return options.prefix + std::to_string(id);
+}
+
+std::string BenchWorker::groupName(int id) const {
+    return options.prefix + "g" + std::to_string(id / options.group_size);
+}
+
+void BenchWorker::connectAll() {
+    sessions.reserve(client_count);
+    for (int i = 0; i < client_count; ++i) {
+        auto client = std::make_unique<Client>(options.host, options.port);
+        if (!client->connectToServer()) {
+            ++shared.connect_failures;
+            continue;
+        }
+
+        // Switch to message framing (sent while the socket still blocks), so
+        // the Client can split replies; everything after is framed
+        if (!client->useMessageFraming()) {
+            ++shared.connect_failures;
+            continue;
+        }
+        int fd = client->getSockFD();
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+        // Reserved above, so the handlers' reference stays put
+        sessions.emplace_back();
+        Session& session = sessions.back();
+        session.client = std::move(client);
+        session.id = first_client + i;
+        session.client->onMessage([this, &session](MessageType, std::string_view content) { handleFrame(session, content); });
+        // File bytes are only counted, never written out
+        session.client->onFile([](const std::string&, std::string_view, bool) {});
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = sessions.size() - 1;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+
+        queueFrame(session, userName(session.id));
+        ++shared.connected;
+    }
+}
+
+// The first client of every group creates it and adds the rest
+void BenchWorker::setupGroups() {
+    for (Session& session : sessions) {
+        if (session.id % options.group_size != 0) continue;
+        std::string group = groupName(session.id);
+        queueFrame(session, "/creategroup " + group);
+        int end = std::min(session.id + options.group_size, options.clients);
+        for (int member = session.id + 1; member < end; ++member)
+            queueFrame(session, "/addmember " + group + " " + userName(member));
+    }
+}
+
+void BenchWorker::run() {
+    connectAll();
+
+    bool groups_sent = false;
+    uint64_t run_start = 0;
+    uint64_t issued = 0;
+    double ops_per_ns = options.rate * sessions.size() / 1e9;
+    std::vector<epoll_event> events(1024);
+
+    while (true) {
+        BenchPhase phase = shared.phase.load();
+        if (phase == BenchPhase::STOP) break;
+
+        if (phase == BenchPhase::SETUP && !groups_sent) {
+            setupGroups();
+            groups_sent = true;
+        }
+
+        // Open loop: issue whatever the schedule says is due, independent of replies
+        if (phase == BenchPhase::RUN && !sessions.empty()) {
+            uint64_t now = nowNs();
+            if (run_start == 0) run_start = now;
+            uint64_t due = (uint64_t)((now - run_start) * ops_per_ns);
+            for (uint64_t n = 0; issued < due && n < MAX_ISSUE_PER_PASS; ++n, ++issued) {
+                Session& session = sessions[rng() % sessions.size()];
+                if (session.alive) issue(session);
+            }
+        }
+
+        int nfds = epoll_wait(epoll_fd, events.data(), events.size(), 1);
+        for (int i = 0; i < nfds; ++i) {
+            Session& session = sessions[events[i].data.u32];
+            if (!session.alive) continue;
+            if (events[i].events & EPOLLOUT) flush(session);
+            if (session.alive && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) handleReadable(session);
+        }
+    }
+}
+
+BenchOp BenchWorker::pickOp() {
+    const int weights[BENCH_OPS] = {options.broadcast, options.msg, options.gmsg, options.list, options.file};
+    int total = 0;
+    for (int w : weights) total += w;
+    int roll = rng() % std::max(1, total);
+    for (size_t i = 0; i < BENCH_OPS; ++i) {
+        if (roll < weights[i]) return (BenchOp)i;
+        roll -= weights[i];
+    }
+    return BenchOp::MSG;
+}
+
+int BenchWorker::pickPeer(int self) {
+    if (options.clients < 2) return self;
+    int peer = rng() % (options.clients - 1);
+    return peer >= self ? peer + 1 : peer;
+}
+
+void BenchWorker::issue(Session& session) {
+    BenchOp op = pickOp();
+    uint64_t now = nowNs();
+    std::string stamp = "@t" + std::to_string(now);
+
+    switch (op) {
+    case BenchOp::BROADCAST:
+        queueFrame(session, stamp);
+        break;
+    case BenchOp::MSG:
+        queueFrame(session, "/msg " + userName(pickPeer(session.id)) + " " + stamp);
+        break;
+    case BenchOp::GMSG:
+        queueFrame(session, "/gmsg " + groupName(session.id) + " " + stamp);
+        break;
+    case BenchOp::LIST:
+        session.list_sent.push_back(now);
+        queueFrame(session, "/list");
+        break;
+    case BenchOp::FILE: {
+        // Relayed upload; the stamp rides in the file name
+        std::string header = session.client->encodeFileHeader(userName(pickPeer(session.id)), "f" + std::to_string(now),
+                                                              file_payload.size());
+        queueRaw(session, header.data(), header.size());
+        queueRaw(session, file_payload.data(), file_payload.size());
+        break;
+    }
+    default:
+        return;
+    }
+    ++results.sent[(size_t)op];
+}
+
+// Level-triggered, so one receive() per event; what it leaves comes back next wait
+void BenchWorker::handleReadable(Session& session) {
+    uint64_t before = session.client->bytesReceived();
+    if (!session.client->receive()) {
+        closeSession(session);
+        return;
+    }
+    if (shared.phase.load() >= BenchPhase::RUN) results.bytes_received += session.client->bytesReceived() - before;
+}
+
+void BenchWorker::handleFrame(Session& session, std::string_view frame) {
+    uint64_t now = nowNs();
+    if (shared.phase.load() >= BenchPhase::RUN) ++results.frames_received;
+    auto record = [&](BenchOp op, uint64_t sent_at) {
+        if (sent_at != 0 && sent_at <= now) results.latency[(size_t)op].record(now - sent_at);
+    };
+
+    if (startsWith(frame, "Welcome, ")) {
+        ++shared.logged_in;
+    } else if (startsWith(frame, "User '") && frame.find("' added to group") != std::string_view::npos) {
+        ++shared.members_added;
+    } else if (startsWith(frame, "Online users:")) {
+        if (!session.list_sent.empty()) {
+            record(BenchOp::LIST, session.list_sent.front());
+            session.list_sent.pop_front();
+        }
+    } else if (startsWith(frame, "Error:")) {
+        if (shared.phase.load() >= BenchPhase::RUN) ++results.errors;
+    } else if (startsWith(frame, "[Private] ")) {
+        record(BenchOp::MSG, stampOf(frame));
+    } else if (startsWith(frame, "[Group ")) {
+        record(BenchOp::GMSG, stampOf(frame));
+    } else if (startsWith(frame, "File 'f") && frame.find("' received successfully") != std::string_view::npos) {
+        record(BenchOp::FILE, parseStamp(frame.substr(7)));
+    } else if (!startsWith(frame, "[Private to ") && !startsWith(frame, "[File incoming]")) {
+        // Plain chat ("user: @t...") is a broadcast; file bytes carry no stamp
+        record(BenchOp::BROADCAST, stampOf(frame));
+    }
+}
+
+void BenchWorker::queueFrame(Session& session, const std::string& text) {
+    std::string frame = session.client->encodeMessage(text);
+    queueRaw(session, frame.data(), frame.size());
+}
+
+void BenchWorker::queueRaw(Session& session, const char* data, size_t len) {
+    session.outbound.append(data, len);
+    if (!session.write_armed) flush(session);
+}
+
+void BenchWorker::flush(Session& session) {
+    int fd = session.client->getSockFD();
+    while (!session.outbound.empty()) {
+        ssize_t n = send(fd, session.outbound.data(), session.outbound.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            closeSession(session);
+            return;
+        }
+        session.outbound.consume(n);
+    }
+
+    bool want_write = !session.outbound.empty();
+    if (want_write == session.write_armed) return;
+    session.write_armed = want_write;
+
+    epoll_event ev;
+    ev.events = want_write ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.u32 = &session - sessions.data();
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void BenchWorker::closeSession(Session& session) {
+    if (!session.alive) return;
+    session.alive = false;
+    if (shared.phase.load() >= BenchPhase::RUN) ++results.errors;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session.client->getSockFD(), nullptr);
+    session.client.reset();
+    session.outbound.clear();
+}
+
+void printBenchReport(const BenchOptions& options, const BenchStats& stats, double seconds) {
+    static const char* names[BENCH_OPS] = {"broadcast", "msg", "gmsg", "list", "file"};
+
+    uint64_t sent = 0;
+    for (uint64_t n : stats.sent) sent += n;
+
+    std::printf("chat_bench: %d clients on %d threads, %.1f s at %.2f ops/client/s\n",
+                options.clients, options.threads, seconds, options.rate);
+    std::printf("%-10s %10s %10s %10s %10s %10s %10s\n",
+                "op", "sent", "delivered", "p50 us", "p99 us", "p999 us", "max us");
+    for (size_t i = 0; i < BENCH_OPS; ++i) {
+        const LatencyHistogram& h = stats.latency[i];
+        std::printf("%-10s %10llu %10llu %10.1f %10.1f %10.1f %10.1f\n", names[i],
+                    (unsigned long long)stats.sent[i], (unsigned long long)h.count(),
+                    h.percentile(50) / 1e3, h.percentile(99) / 1e3, h.percentile(99.9) / 1e3, h.max() / 1e3);
+    }
+    std::printf("throughput: %.0f ops/s sent, %.0f frames/s received (%.2f MB/s), %llu errors\n",
+                sent / seconds, stats.frames_received / seconds,
+                stats.bytes_received / seconds / (1024.0 * 1024.0), (unsigned long long)stats.errors);
+}
+
+} // namespace ChatServer
@@ -0,0 +1,137 @@
+#include "bench.hpp"
+#include <sys/resource.h>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using ChatServer::BenchOptions;
+using ChatServer::BenchPhase;
+
+static void usage() {
+    std::cerr <<
+        "Usage: chat_bench [options]\n"
+        "  --host <addr>        server address (127.0.0.1)\n"
+        "  --port <port>        server port (12345)\n"
+        "  --clients <n>        simulated clients (1000)\n"
+        "  --threads <n>        load-generator threads (4)\n"
+        "  --duration <s>       seconds of measured load (10)\n"
+        "  --rate <ops>         operations per client per second (1)\n"
+        "  --group-size <n>     clients per /gmsg group (10)\n"
+        "  --file-size <bytes>  bytes per relayed /sendfile (65536)\n"
+        "  --prefix <name>      username prefix (bench)\n"
+        "  --mix <weights>      e.g. broadcast=5,msg=55,gmsg=30,list=5,file=5\n";
+}
+
+static bool parseMix(const std::string& spec, BenchOptions& options) {
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        std::string op = item.substr(0, eq);
+        int weight = std::stoi(item.substr(eq + 1));
+        if (op == "broadcast") options.broadcast = weight;
+        else if (op == "msg") options.msg = weight;
+        else if (op == "gmsg") options.gmsg = weight;
+        else if (op == "list") options.list = weight;
+        else if (op == "file") options.file = weight;
+        else return false;
+    }
+    return true;
+}
+
+static bool parseArgs(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string key = argv[i];
+        if (key == "--help" || i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        try {
+            if (key == "--host") options.host = value;
+            else if (key == "--port") options.port = std::stoi(value);
+            else if (key == "--clients") options.clients = std::stoi(value);
+            else if (key == "--threads") options.threads = std::stoi(value);
+            else if (key == "--duration") options.duration = std::stoi(value);
+            else if (key == "--rate") options.rate = std::stod(value);
+            else if (key == "--group-size") options.group_size = std::stoi(value);
+            else if (key == "--file-size") options.file_size = std::stoi(value);
+            else if (key == "--prefix") options.prefix = value;
+            else if (key == "--mix") { if (!parseMix(value, options)) return false; }
+            else return false;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    return options.clients > 0 && options.threads > 0 && options.group_size > 0 && options.file_size >= 0;
+}
+
+// Poll `done` until it holds or `seconds` pass
+template <typename Pred>
+static bool waitFor(Pred done, int seconds) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseArgs(argc, argv, options)) {
+        usage();
+        return 1;
+    }
+    options.threads = std::min(options.threads, options.clients);
+
+    // Every simulated client is a socket
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    ChatServer::BenchShared shared;
+    std::vector<std::unique_ptr<ChatServer::BenchWorker>> workers;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < options.threads; ++t) {
+        int first = (long long)options.clients * t / options.threads;
+        int last = (long long)options.clients * (t + 1) / options.threads;
+        workers.push_back(std::make_unique<ChatServer::BenchWorker>(options, shared, first, last - first));
+    }
+    for (auto& worker : workers) threads.emplace_back([w = worker.get()]() { w->run(); });
+
+    auto stop = [&](int code) {
+        shared.phase = BenchPhase::STOP;
+        for (auto& thread : threads) thread.join();
+        return code;
+    };
+
+    bool ready = waitFor([&]() {
+        return shared.connected + shared.connect_failures == options.clients && shared.logged_in == shared.connected;
+    }, 60);
+    std::cout << shared.logged_in << " clients logged in";
+    if (shared.connect_failures > 0) std::cout << " (" << shared.connect_failures << " failed to connect)";
+    std::cout << std::endl;
+    if (!ready || shared.logged_in == 0) {
+        std::cerr << "chat_bench: clients did not log in; is chat_server running?" << std::endl;
+        return stop(1);
+    }
+
+    int groups = (options.clients + options.group_size - 1) / options.group_size;
+    shared.phase = BenchPhase::SETUP;
+    if (!waitFor([&]() { return shared.members_added >= options.clients - groups; }, 30))
+        std::cerr << "chat_bench: group setup incomplete (" << shared.members_added << "/"
+                  << options.clients - groups << " members)" << std::endl;
+
+    shared.phase = BenchPhase::RUN;
+    std::this_thread::sleep_for(std::chrono::seconds(options.duration));
+    shared.phase = BenchPhase::DRAIN;
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    stop(0);
+
+    ChatServer::BenchStats total;
+    for (auto& worker : workers) total.merge(worker->stats());
+    ChatServer::printBenchReport(options, total, options.duration);
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include "buffer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+static_assert(sizeof(off_t) == 8, "sendfile() offsets must be 64-bit");
+
+namespace ChatServer {
+
+void ByteBuffer::append(const char* data, size_t len) {
+    std::memcpy(prepare(len), data, len);
+    commit(len);
+}
+
+char* ByteBuffer::prepare(size_t len) {
+    if (storage.size() - tail < len) {
+        // Slide live bytes to the front before growing
+        if (head > 0) {
+            std::memmove(storage.data(), storage.data() + head, tail - head);
+            tail -= head;
+            head = 0;
+        }
+        if (storage.size() - tail < len) storage.resize(std::max(storage.size() * 2, tail + len));
+    }
+    return storage.data() + tail;
+}
+
+void ByteBuffer::consume(size_t len) {
+    head += len;
+    if (head >= tail) head = tail = 0;
+}
+
+static bool pipeReadable(int fd) {
+    pollfd pfd{fd, POLLIN, 0};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+FileSource::~FileSource() {
+    close(fd);
+}
+
+void OutboundQueue::push(SharedBuffer data, const FrameHeader& header) {
+    Segment segment{std::move(data), nullptr, 0, 0, 0, header};
+    segment.length = segment.data->size();
+    queued_bytes += header.size + segment.length;
+    segments.push_back(std::move(segment));
+}
+
+void OutboundQueue::pushFile(const SharedFile& file, uint64_t offset, uint64_t length, const FrameHeader& header) {
+    Segment segment{nullptr, file, offset, length, 0, header};
+    queued_bytes += header.size;
+    segments.push_back(std::move(segment));
+}
+
+FlushResult OutboundQueue::flush(int fd) {
+    uint64_t file_budget = FILE_BYTES_PER_FLUSH;
+
+    while (!segments.empty()) {
+        Segment& front = segments.front();
+        if (front.file && front.offset >= front.header.size) {
+            if (file_budget == 0) return FlushResult::YIELDED;
+
+            // Kernel moves page cache / pipe pages -> socket; nothing passes through user space
+            uint64_t sent = front.offset - front.header.size;
+            size_t want = std::min(front.length - sent, file_budget);
+            ssize_t n;
+            if (front.file->pipe) {
+                n = splice(front.file->fd, nullptr, fd, nullptr, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            } else {
+                off_t pos = front.file_offset + sent;
+                n = sendfile(fd, front.file->fd, &pos, want);
+            }
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) return FlushResult::FAILED;
+                // splice() says EAGAIN for an empty pipe as well as a full socket
+                return front.file->pipe && !pipeReadable(front.file->fd) ? FlushResult::STARVED : FlushResult::BLOCKED;
+            }
+            if (n == 0) {
+                // Relay writer gave up early: skip the rest unless a header already promised it
+                if (front.file->pipe && front.header.size == 0) {
+                    segments.pop_front();
+                    continue;
+                }
+                return FlushResult::FAILED; // file shrank under us
+            }
+            file_budget -= n;
+            consume(n);
+            continue;
+        }
+
+        iovec iov[MAX_IOV];
+        size_t count = gather(iov, MAX_IOV);
+
+        // sendmsg rather than writev so a dead peer can't raise SIGPIPE
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? FlushResult::BLOCKED : FlushResult::FAILED;
+        }
+        consume(n);
+    }
+    return FlushResult::DONE;
+}
+
+size_t OutboundQueue::gather(iovec* iov, size_t max) const {
+    size_t count = 0;
+    for (auto it = segments.begin(); it != segments.end() && count + 2 <= max; ++it) {
+        size_t skip = it->offset;
+        if (skip < it->header.size) {
+            iov[count++] = {(char*)it->header.bytes.data() + skip, it->header.size - skip};
+            skip = 0;
+        } else {
+            skip -= it->header.size;
+        }
+        if (it->file) break; // file bytes go through sendfile() on the next pass
+        if (skip < it->length)
+            iov[count++] = {(char*)it->data->data() + skip, it->length - skip};
+    }
+    return count;
+}
+
+void OutboundQueue::consume(size_t len) {
+    sent_bytes += len;
+    while (len > 0) {
+        Segment& front = segments.front();
+        uint64_t left = front.header.size + front.length - front.offset;
+        uint64_t n = std::min<uint64_t>(len, left);
+
+        // Only in-memory bytes (payloads and headers) count toward size()
+        if (!front.file) queued_bytes -= n;
+        else if (front.offset < front.header.size) queued_bytes -= std::min<uint64_t>(n, front.header.size - front.offset);
+
+        len -= n;
+        if (n < left) {
+            front.offset += n;
+            return;
+        }
+        segments.pop_front();
+    }
+}
+
+void OutboundQueue::clear() {
+    segments.clear();
+    queued_bytes = 0;
+}
+
+} // namespace ChatServer
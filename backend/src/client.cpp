@@ -6,6 +6,9 @@
 #include <cstring>
 #include <fstream>
 #include <sys/stat.h>
+#include <cerrno>
+#include <charconv>
+#include <algorithm>
 
 namespace ChatServer {
 
@@ -39,6 +42,25 @@ bool Client::connectToServer() {
     return true; // don't send username here, do it from client_main
 }
 
+bool Client::useMessageFraming() {
+    // Still sent as a line; the server switches after reading it
+    static const char request[] = "/framing message\n";
+    if (!sendAll(request, sizeof(request) - 1)) return false;
+    framed = true;
+    return true;
+}
+
+bool Client::sendAll(const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(sock_fd, data, len, 0);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
 // --- Utility: extract filename ---
 static std::string getFilename(const std::string& path) {
     size_t pos = path.find_last_of("/\\");
@@ -61,8 +83,8 @@ bool Client::sendFile(const std::string& target, const std::string& filepath) {
     std::cout << "Sending file '" << filename << "' (" << filesize << " bytes) to " << target << std::endl;
 
     // Step 1: notify server (only filename, not full path)
-    std::string header = "/sendfile " + target + " " + filename + " " + std::to_string(filesize)+ "\n";
-    if (send(sock_fd, header.c_str(), header.size(), 0) == -1) {
+    std::string header = encodeFileHeader(target, filename, filesize);
+    if (!sendAll(header.c_str(), header.size())) {
         perror("send");
         return false;
     }
@@ -76,85 +98,186 @@ bool Client::sendFile(const std::string& target, const std::string& filepath) {
         int read_bytes = file.gcount();
         if (read_bytes <= 0) break;
 
-        int sent = send(sock_fd, buffer, read_bytes, 0);
-        if (sent <= 0) {
+        if (!sendAll(buffer, read_bytes)) {
             perror("send file chunk");
             return false;
         }
 
-        remaining -= sent;
+        remaining -= read_bytes;
     }
 
     file.close();
     return true;
 }
 
+std::string Client::encodeFileHeader(const std::string& target, const std::string& filename, uint64_t size) const {
+    if (!framed) return "/sendfile " + target + " " + filename + " " + std::to_string(size) + "\n";
 
-void Client::receiveFile(const std::string &filename, int filesize) {
-    std::string save_name = "received_" + filename;  // ✅ prevent overwrite
+    std::string details = filename + " " + std::to_string(size);
+    Message message;
+    message.type = MessageType::FILE_HEADER;
+    message.target = target;
+    message.content = details;
+    return message.serialize();
+}
 
-    std::ofstream outfile(save_name, std::ios::binary);
-    if (!outfile.is_open()) {
-        std::cerr << "Failed to create file: " << save_name << std::endl;
-        return;
+void Client::sendMessage(const std::string& msg) {
+    std::string frame = encodeMessage(msg);
+    sendAll(frame.data(), frame.size());
+}
+
+std::string Client::encodeMessage(const std::string& msg) const {
+    // The server reads '\n'-terminated lines
+    if (!framed) return msg + "\n";
+
+    // Commands go out as COMMAND messages, without the '/'
+    Message message;
+    std::string_view text = msg;
+    if (!text.empty() && text[0] == '/') {
+        message.type = MessageType::COMMAND;
+        text.remove_prefix(1);
     }
+    message.content = text;
+    return message.serialize();
+}
 
-    char buffer[1024];
-    int remaining = filesize;
-    while (remaining > 0) {
-        int chunk_size = std::min(remaining, (int)sizeof(buffer));
-        int bytes = recv(sock_fd, buffer, chunk_size, 0);
-        if (bytes <= 0) break;
-        outfile.write(buffer, bytes);
-        remaining -= bytes;
+bool Client::receive() {
+    char* space = inbound.prepare(RECV_CHUNK);
+    ssize_t bytes = recv(sock_fd, space, RECV_CHUNK, 0);
+    if (bytes < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+    if (bytes <= 0) return false;
+    inbound.commit(bytes);
+    received_bytes += bytes;
+
+    if (!framed) {
+        parseLines();
+        return true;
     }
+    if (parseMessages()) return true;
+    std::cerr << "Malformed message from server.\n";
+    return false;
+}
 
-    outfile.close();
-    std::cout << "File '" << save_name << "' received successfully.\n";
+void Client::listen() {
+    while (receive()) {}
+    std::cout << "Disconnected from server.\n";
 }
 
-void Client::sendMessage(const std::string& msg) {
-    send(sock_fd, msg.c_str(), msg.size(), 0);
+// Every complete message in inbound. A file chunk streams to the sink as its
+// bytes arrive instead of waiting for the whole frame.
+bool Client::parseMessages() {
+    while (!inbound.empty()) {
+        std::string_view buffered(inbound.data(), inbound.size());
+        if (chunk_left > 0) {
+            size_t n = std::min<uint64_t>(chunk_left, buffered.size());
+            writeFile(buffered.substr(0, n));
+            inbound.consume(n);
+            chunk_left -= n;
+            continue;
+        }
+
+        MessageType type;
+        size_t sender_len, target_len, content_len;
+        Message::Decode header = Message::decodeHeader(buffered, type, sender_len, target_len, content_len);
+        if (header == Message::Decode::INCOMPLETE) return true;
+        if (header == Message::Decode::INVALID) return false;
+        if (type == MessageType::FILE_CHUNK && sender_len == 0 && target_len == 0) {
+            inbound.consume(Message::HEADER_SIZE);
+            chunk_left = content_len;
+            continue;
+        }
+
+        // The header checked out, so anything but OK means the body is still arriving
+        Message message;
+        size_t frame_size = 0;
+        if (Message::decode(buffered, UINT32_MAX, message, frame_size) != Message::Decode::OK) return true;
+        dispatch(message.type, message.content);
+        inbound.consume(frame_size);
+    }
+    return true;
 }
 
-void Client::listen() {
-    char buffer[2048];  // bigger buffer just in case
+// Line framing puts nothing between replies, so split on what can be seen:
+// a file announcement ends at " bytes)" and its bytes follow; other text runs
+// up to the next announcement or the end of what arrived.
+void Client::parseLines() {
+    static constexpr std::string_view ANNOUNCE = "[File incoming]";
+    static constexpr std::string_view ANNOUNCE_END = " bytes)";
+
+    while (!inbound.empty()) {
+        std::string_view buffered(inbound.data(), inbound.size());
+        if (file_active) {
+            inbound.consume(writeFile(buffered));
+            continue;
+        }
 
-    while (true) {
-        int bytes = recv(sock_fd, buffer, sizeof(buffer) - 1, 0);
-        if (bytes <= 0) {
-            std::cout << "Disconnected from server.\n";
-            break;
+        if (buffered.substr(0, ANNOUNCE.size()) == ANNOUNCE) {
+            size_t end = buffered.find(ANNOUNCE_END);
+            if (end == std::string_view::npos) return;  // rest of the announcement pending
+            end += ANNOUNCE_END.size();
+            dispatch(MessageType::FILE_HEADER, buffered.substr(0, end));
+            inbound.consume(end);
+            continue;
         }
 
-        buffer[bytes] = '\0';
-        std::string msg(buffer);
+        size_t end = std::min(buffered.find(ANNOUNCE), buffered.size());
+        dispatch(MessageType::TEXT, buffered.substr(0, end));
+        inbound.consume(end);
+    }
+}
 
-        // Detect incoming file
-        if (msg.rfind("[File incoming]", 0) == 0) {
-            std::string filename;
-            int filesize = 0;
+void Client::dispatch(MessageType type, std::string_view content) {
+    if (type == MessageType::FILE_CHUNK) {
+        writeFile(content);
+        return;
+    }
 
-            size_t pos1 = msg.find("] ");
-            size_t pos2 = msg.find(" from ");
-            size_t pos3 = msg.find("(");
+    if (message_handler) message_handler(type, content);
+    else std::cout << content << std::endl;
 
-            if (pos1 != std::string::npos && pos2 != std::string::npos && pos3 != std::string::npos) {
-                filename = msg.substr(pos1 + 2, pos2 - (pos1 + 2));
-                std::string size_str = msg.substr(pos3 + 1, msg.find(" bytes") - (pos3 + 1));
-                filesize = std::stoi(size_str);
-            }
+    if (type == MessageType::FILE_HEADER) beginFile(content);
+}
 
-            std::cout << msg << std::endl;
+// "[File incoming] <filename> from <sender> (<size> bytes)"; the file's bytes follow
+void Client::beginFile(std::string_view header) {
+    static constexpr size_t PREFIX = sizeof("[File incoming] ") - 1;
+    size_t from = header.rfind(" from ");
+    size_t open = header.rfind(" (");
+    if (from == std::string_view::npos || from < PREFIX || open == std::string_view::npos || open < from) return;
+    uint64_t filesize = 0;
+    if (std::from_chars(header.data() + open + 2, header.data() + header.size(), filesize).ec != std::errc()) return;
+
+    if (file_active) file_out.close();  // the previous file was cut short
+    file_name = std::string(header.substr(PREFIX, from - PREFIX));
+    file_left = filesize;
+    file_active = true;
+    if (!file_handler) {
+        std::string save_name = "received_" + file_name;  // ✅ prevent overwrite
+        file_out.open(save_name, std::ios::binary | std::ios::trunc);
+        if (!file_out.is_open()) std::cerr << "Failed to create file: " << save_name << std::endl;
+    }
+    if (file_left == 0) writeFile({});
+}
 
-            // Now receive actual file
-            receiveFile(filename, filesize);
-            continue;
+// Hand bytes of the current file to the sink, up to its announced size;
+// returns how many were taken
+size_t Client::writeFile(std::string_view bytes) {
+    if (!file_active) return bytes.size();  // nothing announced: drop them
+    bytes = bytes.substr(0, std::min<uint64_t>(bytes.size(), file_left));
+    file_left -= bytes.size();
+    bool done = file_left == 0;
+
+    if (file_handler) {
+        file_handler(file_name, bytes, done);
+    } else if (file_out.is_open()) {
+        file_out.write(bytes.data(), bytes.size());
+        if (done) {
+            file_out.close();
+            std::cout << "File 'received_" << file_name << "' received successfully.\n";
         }
-
-        // Regular chat
-        std::cout << msg << std::endl;
     }
+    if (done) file_active = false;
+    return bytes.size();
 }
 
 std::string Client::receiveMessage() {
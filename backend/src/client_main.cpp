@@ -17,6 +17,9 @@ int main() {
         return 1;
     }
 
+    // Typed replies, so listen() can split them and stream files
+    client.useMessageFraming();
+
     // Send username to server
     client.sendMessage(username);
     std::cout << "Username set to " << username << std::endl;
@@ -9,17 +9,43 @@ namespace ChatConfig {
 
     // Defaults (overridden by config.json if provided)
     int SERVER_PORT = 8080;
+    int WEBSOCKET_PORT = 3001;                // where bridge.js used to listen
     int MAX_EVENTS = 1000;
-    int BACKLOG = 50;
+    int BACKLOG = 4096;                       // the kernel caps it at net.core.somaxconn
     int BUFFER_SIZE = 4096;
+    int MAX_OUTBOUND_QUEUE = 8 * 1024 * 1024;
+    bool EDGE_TRIGGERED = false;
+    int MAX_READS_PER_EVENT = 16;
+    int MAX_ACCEPTS_PER_EVENT = 256;
+    int WORKER_THREADS = 1;
+    std::string IO_BACKEND = "epoll";
+    std::string GATEWAY_TOKEN = "";
+    int GATEWAY_SESSION_WINDOW = 256 * 1024;
 
     int MAX_USERNAME_LEN = 32;
     int MAX_MESSAGE_LEN = 1024;
 
     int EPOLL_TIMEOUT = 1000;                 // 1 sec
     int CLIENT_INACTIVITY_TIMEOUT = 300000;   // 5 min
+    int OFFLINE_RETENTION = 86400000;         // 1 day
+    int WRITE_STALL_TIMEOUT = 60000;          // 1 min
+    int FILE_TRANSFER_TIMEOUT = 120000;       // 2 min
+    int HOUSEKEEPING_INTERVAL = 10000;        // 10 sec
+
+    int HISTORY_SIZE = 100;
+    int HISTORY_MEMORY_BUDGET = 64 * 1024 * 1024;
+    bool HISTORY_REPLAY_ON_LOGIN = false;
+    std::string STORE_DIR = "chatstore";
+    int STORE_SEGMENT_BYTES = 64 * 1024 * 1024;
+    int STORE_MAX_SEGMENTS = 16;
 
     std::string LOG_FILE = "chatserver.log";
+    int LOG_MAX_BYTES = 64 * 1024 * 1024;
+    int LOG_MAX_FILES = 5;
+    int LOG_QUEUE_CAPACITY = 65536;
+
+    std::string ADMIN_SOCKET = "chatserver.sock";
+    std::vector<std::string> ADMIN_USERS;
 
     void loadConfig(const std::string &filename) {
         std::ifstream file(filename);
@@ -34,9 +60,18 @@ namespace ChatConfig {
             file >> j;
 
             if (j.contains("port")) SERVER_PORT = j["port"];
+            if (j.contains("websocket_port")) WEBSOCKET_PORT = j["websocket_port"];
             if (j.contains("max_events")) MAX_EVENTS = j["max_events"];
             if (j.contains("backlog")) BACKLOG = j["backlog"];
             if (j.contains("buffer_size")) BUFFER_SIZE = j["buffer_size"];
+            if (j.contains("max_outbound_queue")) MAX_OUTBOUND_QUEUE = j["max_outbound_queue"];
+            if (j.contains("edge_triggered")) EDGE_TRIGGERED = j["edge_triggered"];
+            if (j.contains("max_reads_per_event")) MAX_READS_PER_EVENT = j["max_reads_per_event"];
+            if (j.contains("max_accepts_per_event")) MAX_ACCEPTS_PER_EVENT = j["max_accepts_per_event"];
+            if (j.contains("worker_threads")) WORKER_THREADS = j["worker_threads"];
+            if (j.contains("io_backend")) IO_BACKEND = j["io_backend"];
+            if (j.contains("gateway_token")) GATEWAY_TOKEN = j["gateway_token"];
+            if (j.contains("gateway_session_window")) GATEWAY_SESSION_WINDOW = j["gateway_session_window"];
 
             if (j.contains("max_username_len")) MAX_USERNAME_LEN = j["max_username_len"];
             if (j.contains("max_message_len")) MAX_MESSAGE_LEN = j["max_message_len"];
@@ -44,8 +79,25 @@ namespace ChatConfig {
             if (j.contains("epoll_timeout")) EPOLL_TIMEOUT = j["epoll_timeout"];
             if (j.contains("client_inactivity_timeout"))
                 CLIENT_INACTIVITY_TIMEOUT = j["client_inactivity_timeout"];
+            if (j.contains("offline_retention")) OFFLINE_RETENTION = j["offline_retention"];
+            if (j.contains("write_stall_timeout")) WRITE_STALL_TIMEOUT = j["write_stall_timeout"];
+            if (j.contains("file_transfer_timeout")) FILE_TRANSFER_TIMEOUT = j["file_transfer_timeout"];
+            if (j.contains("housekeeping_interval")) HOUSEKEEPING_INTERVAL = j["housekeeping_interval"];
+
+            if (j.contains("history_size")) HISTORY_SIZE = j["history_size"];
+            if (j.contains("history_memory_budget")) HISTORY_MEMORY_BUDGET = j["history_memory_budget"];
+            if (j.contains("history_replay_on_login")) HISTORY_REPLAY_ON_LOGIN = j["history_replay_on_login"];
+            if (j.contains("store_dir")) STORE_DIR = j["store_dir"];
+            if (j.contains("store_segment_bytes")) STORE_SEGMENT_BYTES = j["store_segment_bytes"];
+            if (j.contains("store_max_segments")) STORE_MAX_SEGMENTS = j["store_max_segments"];
 
             if (j.contains("log_file")) LOG_FILE = j["log_file"];
+            if (j.contains("log_max_bytes")) LOG_MAX_BYTES = j["log_max_bytes"];
+            if (j.contains("log_max_files")) LOG_MAX_FILES = j["log_max_files"];
+            if (j.contains("log_queue_capacity")) LOG_QUEUE_CAPACITY = j["log_queue_capacity"];
+
+            if (j.contains("admin_socket")) ADMIN_SOCKET = j["admin_socket"];
+            if (j.contains("admin_users")) ADMIN_USERS = j["admin_users"].get<std::vector<std::string>>();
 
         } catch (std::exception &e) {
             std::cerr << "[Config] Error parsing config: " << e.what()
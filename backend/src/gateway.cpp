@@ -0,0 +1,22 @@
+#include "gateway.hpp"
+#include "message.hpp"
+
+namespace ChatServer {
+
+void GatewayFrame::encodeHeader(char* out, uint32_t length, uint32_t session, uint8_t op, uint8_t type) {
+    putU32(out, length);
+    putU32(out + 4, session);
+    out[8] = (char)op;
+    out[9] = (char)type;
+}
+
+bool GatewayFrame::decodeHeader(std::string_view buffer, GatewayFrame& out) {
+    if (buffer.size() < HEADER_SIZE) return false;
+    out.length = getU32(buffer.data());
+    out.session = getU32(buffer.data() + 4);
+    out.op = (uint8_t)buffer[8];
+    out.type = (uint8_t)buffer[9];
+    return true;
+}
+
+} // namespace ChatServer
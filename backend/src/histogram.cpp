@@ -0,0 +1,83 @@
+#include "histogram.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace ChatServer {
+
+// Values below 16 get a bucket each; above that, bucket = (msb - 3) * 16 plus
+// the four bits under the most significant one
+int LatencyHistogram::bucketOf(uint64_t value) {
+    if (value < SUB_BUCKETS) return (int)value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BITS;
+    return (shift + 1) * SUB_BUCKETS + (int)((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t LatencyHistogram::bucketCeiling(int bucket) {
+    int group = bucket / SUB_BUCKETS;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    if (group == 0) return sub;
+    int shift = group - 1;
+    // The top bucket's ceiling would overflow; saturate instead
+    if (shift + SUB_BITS + 1 >= 64 && sub == SUB_BUCKETS - 1) return UINT64_MAX;
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    ++counts[bucketOf(value)];
+    ++total;
+    value_sum += value;
+    largest = std::max(largest, value);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < BUCKETS; ++i) counts[i] += other.counts[i];
+    total += other.total;
+    value_sum += other.value_sum;
+    largest = std::max(largest, other.largest);
+}
+
+void LatencyHistogram::reset() {
+    counts.fill(0);
+    total = 0;
+    value_sum = 0;
+    largest = 0;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (total == 0) return 0;
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(total * p / 100.0));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) return std::min(bucketCeiling(i), largest);
+    }
+    return largest;
+}
+
+uint64_t LatencyHistogram::countAtOrBelow(uint64_t value) const {
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS && bucketCeiling(i) <= value; ++i) seen += counts[i];
+    return seen;
+}
+
+void ConcurrentHistogram::record(uint64_t value) {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    std::atomic<uint64_t>& bucket = counts[LatencyHistogram::bucketOf(value)];
+    bucket.store(bucket.load(relaxed) + 1, relaxed);
+    value_sum.store(value_sum.load(relaxed) + value, relaxed);
+    if (value > largest.load(relaxed)) largest.store(value, relaxed);
+}
+
+void ConcurrentHistogram::snapshotInto(LatencyHistogram& out) const {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        uint64_t n = counts[i].load(relaxed);
+        out.counts[i] += n;
+        out.total += n;
+    }
+    out.value_sum += value_sum.load(relaxed);
+    out.largest = std::max(out.largest, largest.load(relaxed));
+}
+
+} // namespace ChatServer
@@ -0,0 +1,72 @@
+#include "history.hpp"
+#include <algorithm>
+
+namespace ChatServer {
+
+HistoryStore::HistoryStore(size_t per_channel, size_t memory_budget)
+    : capacity(per_channel), budget(memory_budget) {}
+
+HistoryStore::Entry* HistoryStore::ring(uint32_t index) const {
+    return slabs[index / RINGS_PER_SLAB].get() + (index % RINGS_PER_SLAB) * capacity;
+}
+
+bool HistoryStore::allocateRing(Channel& ch) {
+    if (rings == slabs.size() * RINGS_PER_SLAB) {
+        size_t size = RINGS_PER_SLAB * capacity * sizeof(Entry);
+        if (slab_bytes + size > budget) return false;
+        slabs.emplace_back(new Entry[RINGS_PER_SLAB * capacity]);
+        slab_bytes += size;
+    }
+    ch.ring = rings++;
+    return true;
+}
+
+void HistoryStore::dropOldest(Channel& ch) {
+    Entry& entry = ring(ch.ring)[ch.first % capacity];
+    line_bytes -= entry.line->size();
+    entry.line.reset();
+    ++ch.first;
+    --stored;
+}
+
+// Stale stamps pile up behind a quiet channel's old lines; squeeze them out
+// once they outnumber the live ones
+void HistoryStore::compactOrder() {
+    auto live = [this](const Stamp& stamp) { return stamp.seq >= channels[stamp.channel].first; };
+    order.erase(std::stable_partition(order.begin(), order.end(), live), order.end());
+}
+
+void HistoryStore::append(uint32_t channel, const SharedBuffer& line) {
+    if (capacity == 0) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (channel >= channels.size()) channels.resize(channel + 1);
+    Channel& ch = channels[channel];
+    if (ch.ring == NO_RING && !allocateRing(ch)) return;
+
+    if (ch.next - ch.first == capacity) dropOldest(ch);
+    ring(ch.ring)[ch.next % capacity] = {line, ch.next};
+    order.push_back({channel, ch.next});
+    ++ch.next;
+    ++stored;
+    line_bytes += line->size();
+
+    // Over budget: evict the oldest lines anywhere
+    while (slab_bytes + line_bytes > budget && !order.empty()) {
+        Stamp oldest = order.front();
+        order.pop_front();
+        Channel& victim = channels[oldest.channel];
+        if (oldest.seq == victim.first && victim.first < victim.next) dropOldest(victim);
+    }
+    if (order.size() > 2 * stored + 64) compactOrder();
+}
+
+void HistoryStore::recent(uint32_t channel, size_t count, std::vector<SharedBuffer>& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (channel >= channels.size() || channels[channel].ring == NO_RING) return;
+    const Channel& ch = channels[channel];
+    const Entry* slots = ring(ch.ring);
+    uint64_t start = ch.next - std::min<uint64_t>(count, ch.next - ch.first);
+    for (uint64_t seq = start; seq < ch.next; ++seq) out.push_back(slots[seq % capacity].line);
+}
+
+} // namespace ChatServer
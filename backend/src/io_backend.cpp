@@ -0,0 +1,70 @@
+#include "io_backend.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+namespace ChatServer {
+
+namespace {
+
+class EpollBackend : public IoBackend {
+public:
+    explicit EpollBackend(size_t max_events) : ready(std::max<size_t>(1, max_events)) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd == -1) { perror("epoll_create1"); exit(EXIT_FAILURE); }
+    }
+
+    ~EpollBackend() override { close(epoll_fd); }
+
+    const char* name() const override { return "epoll"; }
+
+    void add(int fd, uint32_t events) override {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) perror("epoll_ctl");
+    }
+
+    bool modify(int fd, uint32_t events) override {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0 || errno != ENOENT;
+    }
+
+    void remove(int fd) override {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    void wait(std::vector<IoEvent>& events, int timeout_ms) override {
+        int n = epoll_wait(epoll_fd, ready.data(), ready.size(), timeout_ms);
+        if (n == -1) { if (errno != EINTR) perror("epoll_wait"); return; }
+        for (int i = 0; i < n; ++i) events.push_back({IoEvent::Kind::READY, ready[i].data.fd, ready[i].events});
+    }
+
+private:
+    int epoll_fd;
+    std::vector<epoll_event> ready;
+};
+
+} // namespace
+
+std::unique_ptr<IoBackend> makeIoBackend(const std::string& name, size_t max_events, size_t buffer_size) {
+    if (name == "io_uring" || name == "auto") {
+#ifdef CHAT_HAVE_IO_URING
+        if (auto backend = makeUringBackend(max_events, buffer_size)) return backend;
+        if (name == "io_uring") std::cerr << "io_uring unavailable, falling back to epoll" << std::endl;
+#else
+        (void)buffer_size;
+        if (name == "io_uring") std::cerr << "Built without io_uring, falling back to epoll" << std::endl;
+#endif
+    } else if (name != "epoll") {
+        std::cerr << "Unknown io_backend '" << name << "', using epoll" << std::endl;
+    }
+    return std::make_unique<EpollBackend>(max_events);
+}
+
+} // namespace ChatServer
@@ -0,0 +1,528 @@
+#include "io_backend.hpp"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+
+namespace ChatServer {
+
+namespace {
+
+int uringSetup(unsigned entries, io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+int uringEnter(int fd, unsigned submit, unsigned wait, unsigned flags, const void* arg, size_t size) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, arg, size);
+}
+
+int uringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+// user_data: operation (8 bits) | generation of the fd (24) | fd, or send slot (32)
+enum class Op : uint8_t { READY = 1, RECV, ACCEPT, SEND, CANCEL };
+constexpr uint32_t GEN_MASK = 0xFFFFFF;
+
+uint64_t pack(Op op, uint32_t gen, uint32_t index) {
+    return (uint64_t)op << 56 | (uint64_t)(gen & GEN_MASK) << 32 | index;
+}
+
+constexpr unsigned RING_ENTRIES = 4096;
+constexpr unsigned RECV_BUFFERS = 1024;   // power of two
+constexpr uint16_t BUFFER_GROUP = 0;
+constexpr size_t MAX_SEND_IOV = 64;
+constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+// Client sockets are accepted, received from and written through the ring.
+// Plain readiness (pipes, eventfd, timerfd, EPOLLOUT after a short send) stays
+// in an epoll instance that the ring polls, so it keeps epoll's semantics,
+// including forgetting an fd when it is closed.
+class UringBackend : public IoBackend {
+public:
+    UringBackend(size_t max_events, size_t buffer_size)
+        : buffer_size(buffer_size), ready(std::max<size_t>(1, max_events)) {}
+    ~UringBackend() override;
+
+    bool init();
+
+    const char* name() const override { return "io_uring"; }
+
+    void add(int fd, uint32_t events) override;
+    bool modify(int fd, uint32_t events) override;
+    void remove(int fd) override;
+    void addStream(int fd, uint32_t events) override;
+    bool completesReads() const override { return true; }
+    bool acceptMultishot(int fd) override;
+    bool sendsAsync() const override { return true; }
+    void send(int fd, uint64_t tag, const iovec* iov, size_t count) override;
+    void wait(std::vector<IoEvent>& events, int timeout_ms) override;
+
+private:
+    // Ring requests outstanding for a stream or listening socket
+    struct FdState {
+        bool stream = false;
+        bool listener = false;
+        bool dirty = false;           // in `dirty`, to be reconciled before the next enter
+        uint32_t gen = 0;             // bumped by remove(); older completions are stale
+        uint32_t interest = 0;
+        bool in_epoll = false;        // registered for EPOLLOUT / hangups
+        bool recv_armed = false;
+        bool recv_cancelling = false;
+        bool recv_done = false;       // EOF or error reported; don't re-arm
+        bool accept_armed = false;
+        uint32_t send_slot = NO_SLOT;
+    };
+
+    // A SENDMSG in flight; the kernel reads msg and iov until it completes
+    struct SendSlot {
+        msghdr msg;
+        iovec iov[MAX_SEND_IOV];
+        int fd;
+        uint64_t tag;
+    };
+
+    size_t buffer_size;
+    int ring_fd = -1;
+    int epoll_fd = -1;
+    bool epoll_armed = false;         // POLL_ADD on epoll_fd outstanding
+    bool epoll_ready = false;         // ... and it completed this round
+    std::vector<epoll_event> ready;
+
+    // Submission and completion rings (mmap'd from ring_fd)
+    void* sq_ptr = nullptr;
+    size_t sq_size = 0;
+    void* cq_ptr = nullptr;
+    size_t cq_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned sq_local_tail = 0;
+    unsigned sq_submitted = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    // Provided buffer ring: the kernel picks a buffer per received chunk
+    io_uring_buf_ring* buf_ring = nullptr;
+    size_t buf_ring_size = 0;
+    std::vector<char> buffers;
+    uint16_t buf_tail = 0;
+    std::vector<uint16_t> lent;       // handed out in the last wait(), returned in the next
+
+    std::vector<FdState> fds;
+    std::vector<int> dirty;
+    std::deque<SendSlot> send_slots;
+    std::vector<uint32_t> free_slots;
+
+    FdState& state(int fd);
+    void markDirty(int fd);
+    void reconcile(int fd);
+    void epollInterest(int fd, FdState& st);
+    io_uring_sqe* nextSqe();
+    void submit();
+    void cancel(uint64_t user_data);
+    void provideBuffer(uint16_t bid);
+    void complete(const io_uring_cqe& cqe, std::vector<IoEvent>& events);
+    bool selfTest();
+};
+
+UringBackend::~UringBackend() {
+    if (ring_fd != -1) close(ring_fd);
+    if (epoll_fd != -1) close(epoll_fd);
+    if (sqes) munmap(sqes, sqes_size);
+    if (cq_ptr && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+    if (sq_ptr) munmap(sq_ptr, sq_size);
+    if (buf_ring) munmap(buf_ring, buf_ring_size);
+}
+
+bool UringBackend::init() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) return false;
+
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = RING_ENTRIES * 4;
+    ring_fd = uringSetup(RING_ENTRIES, &params);
+    if (ring_fd < 0) return false;
+
+    // EXT_ARG: wait with a timeout in io_uring_enter(); NODROP: no lost completions
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) return false;
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) sq_size = cq_size = std::max(sq_size, cq_size);
+
+    sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) { sq_ptr = nullptr; return false; }
+    cq_ptr = single_mmap ? sq_ptr
+                         : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED) { cq_ptr = nullptr; return false; }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqe_map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqe_map == MAP_FAILED) return false;
+    sqes = (io_uring_sqe*)sqe_map;
+
+    char* sq = (char*)sq_ptr;
+    sq_head = (unsigned*)(sq + params.sq_off.head);
+    sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    sq_local_tail = sq_submitted = *sq_tail;
+    unsigned* sq_array = (unsigned*)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries; ++i) sq_array[i] = i;
+
+    char* cq = (char*)cq_ptr;
+    cq_head = (unsigned*)(cq + params.cq_off.head);
+    cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    buf_ring_size = RECV_BUFFERS * sizeof(io_uring_buf);
+    void* ring_map = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring_map == MAP_FAILED) return false;
+    buf_ring = (io_uring_buf_ring*)ring_map;
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = (uint64_t)buf_ring;
+    reg.ring_entries = RECV_BUFFERS;
+    reg.bgid = BUFFER_GROUP;
+    if (uringRegister(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+
+    buffers.resize(RECV_BUFFERS * buffer_size);
+    for (unsigned bid = 0; bid < RECV_BUFFERS; ++bid) provideBuffer(bid);
+    __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+
+    return selfTest();
+}
+
+// Multishot recv with provided buffers needs Linux 6.0; the setup calls above
+// can succeed on older kernels, so try one on a socketpair
+bool UringBackend::selfTest() {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pair) == -1) return false;
+    addStream(pair[0], EPOLLIN);
+    bool ok = write(pair[1], "x", 1) == 1;
+
+    std::vector<IoEvent> events;
+    for (int attempt = 0; ok && attempt < 10 && events.empty(); ++attempt) wait(events, 100);
+    ok = ok && events.size() == 1 && events[0].kind == IoEvent::Kind::RECEIVED && events[0].result == 1;
+
+    remove(pair[0]);
+    close(pair[0]);
+    close(pair[1]);
+    events.clear();
+    wait(events, 0);
+    return ok;
+}
+
+UringBackend::FdState& UringBackend::state(int fd) {
+    if ((size_t)fd >= fds.size()) fds.resize(std::max<size_t>(fd + 1, fds.size() * 2));
+    return fds[fd];
+}
+
+void UringBackend::markDirty(int fd) {
+    FdState& st = fds[fd];
+    if (st.dirty) return;
+    st.dirty = true;
+    dirty.push_back(fd);
+}
+
+void UringBackend::add(int fd, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) perror("epoll_ctl");
+}
+
+void UringBackend::addStream(int fd, uint32_t events) {
+    FdState& st = state(fd);
+    st.stream = true;
+    st.interest = events;
+    epollInterest(fd, st);
+    markDirty(fd);
+}
+
+bool UringBackend::acceptMultishot(int fd) {
+    state(fd).listener = true;
+    markDirty(fd);
+    return true;
+}
+
+bool UringBackend::modify(int fd, uint32_t events) {
+    if ((size_t)fd < fds.size() && fds[fd].stream) {
+        FdState& st = fds[fd];
+        st.interest = events;
+        epollInterest(fd, st);
+        markDirty(fd);
+        return true;
+    }
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0 || errno != ENOENT;
+}
+
+// A stream needs epoll only for EPOLLOUT, or for hangups while its receive is
+// paused; once registered it stays until remove()
+void UringBackend::epollInterest(int fd, FdState& st) {
+    uint32_t mask = st.interest & ~(uint32_t)(EPOLLIN | EPOLLRDHUP);
+    if (!st.in_epoll && !(mask & EPOLLOUT) && (st.interest & EPOLLIN)) return;
+
+    epoll_event ev{};
+    ev.events = mask;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, st.in_epoll ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) == -1) perror("epoll_ctl");
+    st.in_epoll = true;
+}
+
+// Cancel the ring's requests on fd and forget it. Called before close(): a
+// send still queued goes in now, while fd still names the socket (a final
+// message before a kick); the cancels go in with the next enter and drop the
+// kernel's file references, which a send waiting on a full socket would hold.
+void UringBackend::remove(int fd) {
+    if ((size_t)fd >= fds.size() || !(fds[fd].stream || fds[fd].listener)) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        return;
+    }
+    FdState& st = fds[fd];
+    if (st.in_epoll) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    if (st.recv_armed) cancel(pack(Op::RECV, st.gen, fd));
+    if (st.accept_armed) cancel(pack(Op::ACCEPT, st.gen, fd));
+    if (st.send_slot != NO_SLOT) {
+        submit();
+        cancel(pack(Op::SEND, 0, st.send_slot));
+    }
+
+    FdState next;
+    next.gen = (st.gen + 1) & GEN_MASK;
+    next.dirty = st.dirty;  // still listed; reconcile() finds nothing to do
+    st = next;
+}
+
+void UringBackend::send(int fd, uint64_t tag, const iovec* iov, size_t count) {
+    uint32_t slot;
+    if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        slot = send_slots.size();
+        send_slots.emplace_back();
+    }
+
+    SendSlot& s = send_slots[slot];
+    count = std::min(count, MAX_SEND_IOV);
+    std::memcpy(s.iov, iov, count * sizeof(iovec));
+    s.msg = msghdr{};
+    s.msg.msg_iov = s.iov;
+    s.msg.msg_iovlen = count;
+    s.fd = fd;
+    s.tag = tag;
+    state(fd).send_slot = slot;
+
+    // Goes in with the next wait(), together with every other send queued this pass
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)&s.msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = pack(Op::SEND, 0, slot);
+}
+
+// Bring the ring's requests for fd in line with its interest
+void UringBackend::reconcile(int fd) {
+    FdState& st = fds[fd];
+    st.dirty = false;
+
+    if (st.listener) {
+        if (st.accept_armed) return;
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        sqe->user_data = pack(Op::ACCEPT, st.gen, fd);
+        st.accept_armed = true;
+        return;
+    }
+    if (!st.stream) return;
+
+    bool want_recv = (st.interest & EPOLLIN) && !st.recv_done;
+    if (want_recv && !st.recv_armed) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = pack(Op::RECV, st.gen, fd);
+        st.recv_armed = true;
+    } else if (!want_recv && st.recv_armed && !st.recv_cancelling) {
+        cancel(pack(Op::RECV, st.gen, fd));
+        st.recv_cancelling = true;
+    }
+}
+
+io_uring_sqe* UringBackend::nextSqe() {
+    if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries) submit();
+    io_uring_sqe* sqe = &sqes[sq_local_tail & sq_mask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++sq_local_tail;
+    return sqe;
+}
+
+// Early submit when the queue fills up between two waits
+void UringBackend::submit() {
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    unsigned count = sq_local_tail - sq_submitted;
+    if (count == 0) return;
+    int n = uringEnter(ring_fd, count, 0, 0, nullptr, 0);
+    if (n > 0) sq_submitted += n;
+}
+
+void UringBackend::cancel(uint64_t user_data) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = pack(Op::CANCEL, 0, 0);
+}
+
+// Only addr/len/bid: the ring's tail lives in the first entry's resv field.
+// Entries are indexed off the ring's start, not `bufs`: the kernel header's
+// flexible-array wrapper puts that at offset 8 when compiled as C++.
+void UringBackend::provideBuffer(uint16_t bid) {
+    io_uring_buf& buf = reinterpret_cast<io_uring_buf*>(buf_ring)[buf_tail & (RECV_BUFFERS - 1)];
+    buf.addr = (uint64_t)(buffers.data() + (size_t)bid * buffer_size);
+    buf.len = buffer_size;
+    buf.bid = bid;
+    ++buf_tail;
+}
+
+void UringBackend::wait(std::vector<IoEvent>& events, int timeout_ms) {
+    // The loop is done with last round's data
+    for (uint16_t bid : lent) provideBuffer(bid);
+    if (!lent.empty()) __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+    lent.clear();
+
+    for (size_t i = 0; i < dirty.size(); ++i) reconcile(dirty[i]);
+    dirty.clear();
+
+    // One-shot, so level-triggered fds still on epoll's ready list complete it at once
+    if (!epoll_armed) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = epoll_fd;
+        sqe->poll32_events = EPOLLIN;
+        sqe->user_data = pack(Op::READY, 0, 0);
+        epoll_armed = true;
+    }
+
+    // One enter submits everything queued since the last one and waits
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    unsigned count = sq_local_tail - sq_submitted;
+    int n;
+    if (timeout_ms == 0) {
+        n = uringEnter(ring_fd, count, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+    } else {
+        __kernel_timespec ts{timeout_ms / 1000, (timeout_ms % 1000) * 1000000LL};
+        io_uring_getevents_arg arg{};
+        arg.ts = timeout_ms < 0 ? 0 : (uint64_t)&ts;
+        n = uringEnter(ring_fd, count, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+    if (n > 0) sq_submitted += n;
+    else if (n < 0 && errno != EINTR && errno != ETIME && errno != EBUSY) perror("io_uring_enter");
+
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) complete(cqes[head & cq_mask], events);
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    if (epoll_ready) {
+        epoll_ready = false;
+        int ready_count = epoll_wait(epoll_fd, ready.data(), ready.size(), 0);
+        for (int i = 0; i < ready_count; ++i)
+            events.push_back({IoEvent::Kind::READY, ready[i].data.fd, ready[i].events});
+    }
+}
+
+void UringBackend::complete(const io_uring_cqe& cqe, std::vector<IoEvent>& events) {
+    Op op = (Op)(cqe.user_data >> 56);
+    uint32_t gen = (cqe.user_data >> 32) & GEN_MASK;
+    uint32_t index = (uint32_t)cqe.user_data;
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+
+    switch (op) {
+    case Op::READY:
+        epoll_armed = false;
+        epoll_ready = true;
+        return;
+    case Op::SEND: {
+        SendSlot& s = send_slots[index];
+        if ((size_t)s.fd < fds.size() && fds[s.fd].send_slot == index) fds[s.fd].send_slot = NO_SLOT;
+        events.push_back({IoEvent::Kind::SENT, s.fd, 0, cqe.res, nullptr, s.tag});
+        free_slots.push_back(index);
+        return;
+    }
+    case Op::RECV: {
+        int fd = (int)index;
+        FdState& st = fds[fd];
+        bool stale = st.gen != gen;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            lent.push_back(bid);
+            if (!stale && cqe.res > 0)
+                events.push_back({IoEvent::Kind::RECEIVED, fd, 0, cqe.res, buffers.data() + (size_t)bid * buffer_size});
+        }
+        if (stale || more) return;
+
+        st.recv_armed = false;
+        st.recv_cancelling = false;
+        // Out of buffers, or cancelled by a pause: re-armed as the interest says.
+        // EOF or a real error is reported once.
+        if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)) {
+            st.recv_done = true;
+            events.push_back({IoEvent::Kind::RECEIVED, fd, 0, cqe.res});
+        }
+        markDirty(fd);
+        return;
+    }
+    case Op::ACCEPT: {
+        FdState& st = fds[index];
+        if (st.gen != gen) {
+            if (cqe.res >= 0) close(cqe.res);
+            return;
+        }
+        if (cqe.res >= 0) events.push_back({IoEvent::Kind::ACCEPTED, (int)index, 0, cqe.res});
+        if (!more) {
+            st.accept_armed = false;
+            markDirty(index);
+        }
+        return;
+    }
+    default:
+        return;
+    }
+}
+
+} // namespace
+
+std::unique_ptr<IoBackend> makeUringBackend(size_t max_events, size_t buffer_size) {
+    auto backend = std::make_unique<UringBackend>(max_events, buffer_size);
+    if (!backend->init()) return nullptr;
+    return backend;
+}
+
+} // namespace ChatServer
@@ -0,0 +1,151 @@
+#include "logger.hpp"
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace ChatServer {
+
+Logger::Logger(const std::string& path, size_t queue_capacity, size_t max_bytes, int max_files)
+    : path(path), max_bytes(max_bytes), max_files(max_files) {
+    // Round capacity up to a power of two so positions map to cells with a mask
+    size_t capacity = 2;
+    while (capacity < queue_capacity) capacity <<= 1;
+    cells = std::make_unique<Cell[]>(capacity);
+    for (size_t i = 0; i < capacity; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+    mask = capacity - 1;
+
+    openFile();
+    writer = std::thread([this]() { writerLoop(); });
+}
+
+Logger::~Logger() {
+    stopping.store(true, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake_ready.notify_one();
+    }
+    if (writer.joinable()) writer.join();
+    if (fd != -1) close(fd);
+}
+
+bool Logger::log(std::string line) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed); // writer is behind (slow disk)
+            return false;
+        } else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->data = std::move(line);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    // Pairs with the fence in writerLoop(): either the writer sees this line
+    // before it sleeps, or it is seen asleep here and woken
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (writer_idle.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake_ready.notify_one();
+    }
+    return true;
+}
+
+bool Logger::hasPending() const {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    return cells[pos & mask].sequence.load(std::memory_order_acquire) == pos + 1;
+}
+
+bool Logger::tryPop(std::string& out) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    Cell& cell = cells[pos & mask];
+    if (cell.sequence.load(std::memory_order_acquire) != pos + 1) return false;
+
+    out = std::move(cell.data);
+    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+    dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+void Logger::writerLoop() {
+    std::string batch;
+    std::string line;
+    uint64_t reported_drops = 0;
+
+    while (true) {
+        bool stop = stopping.load(std::memory_order_acquire);
+
+        // Group everything queued so far into one write
+        batch.clear();
+        while (tryPop(line)) {
+            batch += line;
+            batch += '\n';
+        }
+
+        uint64_t drops = dropped.load(std::memory_order_relaxed);
+        if (drops != reported_drops) {
+            batch += "[Logger] dropped " + std::to_string(drops - reported_drops) + " line(s)\n";
+            reported_drops = drops;
+        }
+
+        if (!batch.empty()) {
+            writeBatch(batch);
+            continue;
+        }
+        if (stop) break;
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        writer_idle.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wake_ready.wait(lock, [this]() { return stopping.load(std::memory_order_acquire) || hasPending(); });
+        writer_idle.store(false, std::memory_order_relaxed);
+    }
+}
+
+void Logger::writeBatch(const std::string& batch) {
+    if (fd == -1) return;
+
+    size_t written = 0;
+    while (written < batch.size()) {
+        ssize_t n = write(fd, batch.data() + written, batch.size() - written);
+        if (n <= 0) {
+            perror("log write");
+            return;
+        }
+        written += n;
+    }
+
+    file_bytes += written;
+    if (max_bytes > 0 && file_bytes >= max_bytes) rotate();
+}
+
+void Logger::openFile() {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        perror(("open " + path).c_str());
+        return;
+    }
+
+    struct stat st;
+    file_bytes = fstat(fd, &st) == 0 ? st.st_size : 0;
+}
+
+// chat.log -> chat.log.1 -> ... -> chat.log.<max_files>; the oldest falls off
+void Logger::rotate() {
+    close(fd);
+    for (int i = max_files - 1; i >= 1; --i)
+        std::rename((path + "." + std::to_string(i)).c_str(), (path + "." + std::to_string(i + 1)).c_str());
+    if (max_files > 0) std::rename(path.c_str(), (path + ".1").c_str());
+    else unlink(path.c_str());
+    openFile();
+}
+
+} // namespace ChatServer
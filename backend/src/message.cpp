@@ -1,27 +1,74 @@
 #include "message.hpp"
-#include <sstream>
+#include <cstring>
 
 namespace ChatServer {
 
+// type, sender length, target length
+static constexpr size_t FIELDS_SIZE = Message::HEADER_SIZE - 4;
+
+void Message::encodeHeader(char* out, MessageType type, size_t sender_len, size_t target_len, size_t content_len) {
+    putU32(out, FIELDS_SIZE + sender_len + target_len + content_len);
+    out[4] = (char)type;
+    putU16(out + 5, sender_len);
+    putU16(out + 7, target_len);
+}
+
+void Message::encodeTo(char* out) const {
+    encodeHeader(out, type, sender.size(), target.size(), content.size());
+    out += HEADER_SIZE;
+    std::memcpy(out, sender.data(), sender.size());
+    out += sender.size();
+    std::memcpy(out, target.data(), target.size());
+    out += target.size();
+    std::memcpy(out, content.data(), content.size());
+}
+
+void Message::appendTo(std::string& out) const {
+    size_t at = out.size();
+    out.resize(at + encodedSize());
+    encodeTo(out.data() + at);
+}
+
 std::string Message::serialize() const {
-    std::ostringstream oss;
-    oss << static_cast<int>(type) << "|" << sender << "|" << content;
-    return oss.str();
+    std::string out;
+    appendTo(out);
+    return out;
 }
 
-Message Message::deserialize(const std::string& raw) {
-    Message msg;
-    std::istringstream iss(raw);
-    std::string typeStr, senderStr, contentStr;
+Message::Decode Message::decode(std::string_view buffer, size_t max_body, Message& out, size_t& frame_size) {
+    if (buffer.size() < 4) return Decode::INCOMPLETE;
+    uint32_t body = getU32(buffer.data());
+    frame_size = 4 + (size_t)body;
+    if (body > max_body + FIELDS_SIZE) return Decode::TOO_LARGE;
+    if (buffer.size() < frame_size) return Decode::INCOMPLETE;
+    if (body < FIELDS_SIZE) return Decode::INVALID;
 
-    std::getline(iss, typeStr, '|');
-    std::getline(iss, senderStr, '|');
-    std::getline(iss, contentStr, '|');
+    const char* p = buffer.data() + 4;
+    uint8_t type = (uint8_t)p[0];
+    size_t sender_len = getU16(p + 1);
+    size_t target_len = getU16(p + 3);
+    if (type >= MESSAGE_TYPE_COUNT || FIELDS_SIZE + sender_len + target_len > body) return Decode::INVALID;
+
+    p += FIELDS_SIZE;
+    out.type = (MessageType)type;
+    out.sender = {p, sender_len};
+    out.target = {p + sender_len, target_len};
+    out.content = {p + sender_len + target_len, body - FIELDS_SIZE - sender_len - target_len};
+    return Decode::OK;
+}
 
-    msg.type = static_cast<MessageType>(std::stoi(typeStr));
-    msg.sender = senderStr;
-    msg.content = contentStr;
-    return msg;
+Message::Decode Message::decodeHeader(std::string_view buffer, MessageType& type, size_t& sender_len,
+                                      size_t& target_len, size_t& content_len) {
+    if (buffer.size() < HEADER_SIZE) return Decode::INCOMPLETE;
+    uint32_t body = getU32(buffer.data());
+    uint8_t raw_type = (uint8_t)buffer[4];
+    sender_len = getU16(buffer.data() + 5);
+    target_len = getU16(buffer.data() + 7);
+    if (body < FIELDS_SIZE || raw_type >= MESSAGE_TYPE_COUNT || FIELDS_SIZE + sender_len + target_len > body)
+        return Decode::INVALID;
+    type = (MessageType)raw_type;
+    content_len = body - FIELDS_SIZE - sender_len - target_len;
+    return Decode::OK;
 }
 
 } // namespace ChatServer
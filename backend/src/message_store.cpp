@@ -0,0 +1,290 @@
+#include "message_store.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace ChatServer {
+
+static constexpr uint32_t RECORD_MAGIC = 0x314D4843;  // "CHM1"
+static constexpr size_t RECORD_ALIGN = 8;
+static constexpr uint8_t RECORD_RESET = 0x01;
+static_assert(sizeof(MessageStore::RecordHeader) == 32, "record header layout is part of the file format");
+
+MessageStore::MessageStore(const std::string& dir, size_t segment_bytes, int max_segments)
+    : dir(dir), max_segments(max_segments) {
+    // Offsets are 32-bit; a segment must at least hold one full-size record
+    this->segment_bytes = std::clamp<size_t>(segment_bytes, 64 * 1024, UINT32_MAX);
+
+    if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+        perror(("mkdir " + dir).c_str());
+        exit(EXIT_FAILURE);
+    }
+    recover();
+    writer = std::thread([this]() { writerLoop(); });
+}
+
+MessageStore::~MessageStore() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_ready.notify_one();
+    if (writer.joinable()) writer.join();
+
+    for (Segment& segment : segments) {
+        fdatasync(segment.fd);
+        munmap((void*)segment.map, segment.size);
+        close(segment.fd);
+    }
+}
+
+size_t MessageStore::recordSize(const RecordHeader& header) {
+    return (sizeof(RecordHeader) + header.length + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+std::string MessageStore::segmentPath(uint32_t number) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%010u.seg", number);
+    return dir + name;
+}
+
+// Map an existing segment, or create and size a new one
+MessageStore::Segment MessageStore::openSegment(uint32_t number) {
+    std::string path = segmentPath(number);
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        perror(("open " + path).c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat st;
+    fstat(fd, &st);
+    size_t size = st.st_size;
+    if (size == 0) {
+        size = segment_bytes;
+        if (ftruncate(fd, size) == -1) {
+            perror(("ftruncate " + path).c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror(("mmap " + path).c_str());
+        exit(EXIT_FAILURE);
+    }
+    return Segment{number, fd, (const char*)map, size, 0};
+}
+
+// Reopen every segment in order and rebuild the index from record headers;
+// a torn record at the tail marks where appending resumes
+void MessageStore::recover() {
+    std::vector<uint32_t> numbers;
+    if (DIR* listing = opendir(dir.c_str())) {
+        while (dirent* entry = readdir(listing)) {
+            unsigned number;
+            char tail;
+            if (sscanf(entry->d_name, "%10u.se%c", &number, &tail) == 2 && tail == 'g') numbers.push_back(number);
+        }
+        closedir(listing);
+    }
+    std::sort(numbers.begin(), numbers.end());
+    if (numbers.empty()) numbers.push_back(0);
+
+    // Locations find segments by number, so only a contiguous run is usable
+    auto gap = std::adjacent_find(numbers.rbegin(), numbers.rend(), [](uint32_t a, uint32_t b) { return a != b + 1; });
+    if (gap != numbers.rend()) numbers.erase(numbers.begin(), gap.base() - 1);
+
+    for (uint32_t number : numbers) {
+        segments.push_back(openSegment(number));
+        scanSegment(segments.back());
+    }
+}
+
+void MessageStore::scanSegment(Segment& segment) {
+    size_t offset = 0;
+    while (offset + sizeof(RecordHeader) <= segment.size) {
+        RecordHeader header;
+        std::memcpy(&header, segment.map + offset, sizeof(header));
+        size_t size = recordSize(header);
+        if (header.magic != RECORD_MAGIC || offset + size > segment.size) break;
+
+        indexRecord(segment, offset);
+        // Only recovery touches next_seq here; afterwards append() owns it
+        std::string channel(segment.map + offset + sizeof(RecordHeader), header.channel_len);
+        uint64_t& next = next_seq[channel];
+        next = std::max(next, header.seq + 1);
+        offset += size;
+    }
+    segment.used = offset;
+}
+
+void MessageStore::indexRecord(const Segment& segment, size_t offset) {
+    RecordHeader header;
+    std::memcpy(&header, segment.map + offset, sizeof(header));
+    std::string channel(segment.map + offset + sizeof(RecordHeader), header.channel_len);
+
+    ChannelIndex& index = channels[channel];
+    if (header.flags & RECORD_RESET) {
+        index.locations.clear();
+        index.first_seq = header.seq + 1;
+        return;
+    }
+    // Sequence numbers are dense per channel; a gap (lost tail) restarts the index
+    if (index.locations.empty() || header.seq != index.first_seq + index.locations.size()) {
+        index.locations.clear();
+        index.first_seq = header.seq;
+    }
+    index.locations.push_back({segment.number, (uint32_t)offset});
+}
+
+bool MessageStore::append(std::string_view channel, std::string_view line) {
+    return enqueue(channel, line, 0);
+}
+
+// The marker takes a sequence number like any line, so the ones after it
+// stay dense; the index forgets the channel now and again when it is written
+void MessageStore::resetChannel(std::string_view channel) {
+    {
+        std::unique_lock lock(mutex);
+        channels.erase(std::string(channel));
+    }
+    enqueue(channel, {}, RECORD_RESET);
+}
+
+bool MessageStore::enqueue(std::string_view channel, std::string_view line, uint8_t flags) {
+    RecordHeader header{};
+    header.magic = RECORD_MAGIC;
+    header.length = channel.size() + line.size();
+    header.channel_len = channel.size();
+    header.flags = flags;
+    header.time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    size_t size = recordSize(header);
+    if (size > segment_bytes) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        // The writer is a whole segment behind (stalled disk): drop rather than
+        // grow. Never a reset marker, or the old lines would come back.
+        if (!(flags & RECORD_RESET) && pending.size() + size > segment_bytes) return false;
+
+        header.seq = next_seq[std::string(channel)]++;
+        pending.append((const char*)&header, sizeof(header));
+        pending.append(channel);
+        pending.append(line);
+        pending.append(size - sizeof(header) - header.length, '\0');
+    }
+    queue_ready.notify_one();
+    return true;
+}
+
+void MessageStore::recent(std::string_view channel, size_t count, std::vector<SharedBuffer>& out) const {
+    std::shared_lock lock(mutex);
+    auto it = channels.find(std::string(channel));
+    if (it == channels.end()) return;
+
+    const std::deque<Location>& locations = it->second.locations;
+    uint32_t first_segment = segments.front().number;
+    for (size_t i = locations.size() - std::min(count, locations.size()); i < locations.size(); ++i) {
+        const Segment& segment = segments[locations[i].segment - first_segment];
+        const char* record = segment.map + locations[i].offset;
+        RecordHeader header;
+        std::memcpy(&header, record, sizeof(header));
+        const char* line = record + sizeof(RecordHeader) + header.channel_len;
+        out.push_back(makeBuffer(std::string(line, header.length - header.channel_len)));
+    }
+}
+
+void MessageStore::writerLoop() {
+    std::string batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_ready.wait(lock, [this]() { return stopping || !pending.empty(); });
+            if (pending.empty()) break;
+            batch.swap(pending);
+        }
+        writeBatch(batch);
+        batch.clear();
+    }
+}
+
+// Write as many whole records as fit in the current segment with one
+// pwrite(), index them, and roll to a new segment for the rest
+void MessageStore::writeBatch(const std::string& batch) {
+    size_t pos = 0;
+    while (pos < batch.size()) {
+        Segment& segment = segments.back();
+        size_t end = pos;
+        while (end < batch.size()) {
+            RecordHeader header;
+            std::memcpy(&header, batch.data() + end, sizeof(header));
+            size_t size = recordSize(header);
+            if (segment.used + (end - pos) + size > segment.size) break;
+            end += size;
+        }
+        if (end == pos) {
+            rollSegment();
+            continue;
+        }
+
+        size_t written = 0;
+        while (written < end - pos) {
+            ssize_t n = pwrite(segment.fd, batch.data() + pos + written, end - pos - written, segment.used + written);
+            if (n <= 0) {
+                perror("message store write");
+                return;
+            }
+            written += n;
+        }
+
+        std::unique_lock lock(mutex);
+        for (size_t offset = segment.used; offset < segment.used + written;) {
+            indexRecord(segment, offset);
+            RecordHeader header;
+            std::memcpy(&header, segment.map + offset, sizeof(header));
+            offset += recordSize(header);
+        }
+        segment.used += written;
+        pos = end;
+    }
+}
+
+void MessageStore::rollSegment() {
+    fdatasync(segments.back().fd);
+    Segment next = openSegment(segments.back().number + 1);
+
+    std::unique_lock lock(mutex);
+    segments.push_back(next);
+    while (max_segments > 0 && segments.size() > (size_t)max_segments) dropOldestSegment();
+}
+
+// Retention: forget the oldest segment's lines, then delete the file
+void MessageStore::dropOldestSegment() {
+    Segment oldest = segments.front();
+    for (auto it = channels.begin(); it != channels.end();) {
+        ChannelIndex& index = it->second;
+        while (!index.locations.empty() && index.locations.front().segment == oldest.number) {
+            index.locations.pop_front();
+            ++index.first_seq;
+        }
+        if (index.locations.empty()) it = channels.erase(it);
+        else ++it;
+    }
+
+    segments.pop_front();
+    munmap((void*)oldest.map, oldest.size);
+    close(oldest.fd);
+    unlink(segmentPath(oldest.number).c_str());
+}
+
+} // namespace ChatServer
@@ -0,0 +1,171 @@
+#include "metrics.hpp"
+#include "logger.hpp"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace ChatServer {
+
+// Histogram buckets exported to Prometheus, in ns (1us .. 1s, decade steps)
+static constexpr uint64_t EXPORT_BOUNDS_NS[] = {1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+static constexpr const char* EXPORT_BOUNDS_LABEL[] = {"1e-06", "1e-05", "0.0001", "0.001", "0.01", "0.1", "1"};
+
+// How long a stats client gets to send its (optional) request line
+static constexpr int REQUEST_TIMEOUT_MS = 100;
+
+static void appendHeader(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP "; out += name; out += ' '; out += help; out += '\n';
+    out += "# TYPE "; out += name; out += ' '; out += type; out += '\n';
+}
+
+static void appendSample(std::string& out, const char* name, const std::string& labels, const std::string& value) {
+    out += name;
+    if (!labels.empty()) { out += '{'; out += labels; out += '}'; }
+    out += ' '; out += value; out += '\n';
+}
+
+// One histogram series: cumulative buckets, then _sum and _count (seconds)
+static void appendHistogram(std::string& out, const char* name, const std::string& labels, const LatencyHistogram& h) {
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    std::string bucket = std::string(name) + "_bucket";
+    for (size_t i = 0; i < std::size(EXPORT_BOUNDS_NS); ++i)
+        appendSample(out, bucket.c_str(), prefix + "le=\"" + EXPORT_BOUNDS_LABEL[i] + "\"",
+                     std::to_string(h.countAtOrBelow(EXPORT_BOUNDS_NS[i])));
+    appendSample(out, bucket.c_str(), prefix + "le=\"+Inf\"", std::to_string(h.count()));
+
+    char sum[32];
+    std::snprintf(sum, sizeof(sum), "%.9f", h.sum() / 1e9);
+    appendSample(out, (std::string(name) + "_sum").c_str(), labels, sum);
+    appendSample(out, (std::string(name) + "_count").c_str(), labels, std::to_string(h.count()));
+}
+
+Metrics::Metrics(size_t shard_count, std::vector<std::string> handler_names, const Logger& logger)
+    : handler_names(std::move(handler_names)), logger(logger) {
+    for (size_t i = 0; i < shard_count; ++i)
+        shards.push_back(std::make_unique<ShardMetrics>(this->handler_names.size()));
+}
+
+std::string Metrics::render() const {
+    std::string out;
+    out.reserve(16 * 1024);
+
+    auto perShard = [&](const char* name, const char* type, const char* help, auto value) {
+        appendHeader(out, name, type, help);
+        for (size_t i = 0; i < shards.size(); ++i)
+            appendSample(out, name, "shard=\"" + std::to_string(i) + "\"", std::to_string(value(*shards[i])));
+    };
+
+    perShard("chat_connections_accepted_total", "counter", "Connections accepted.",
+             [](const ShardMetrics& s) { return s.accepted.get(); });
+    perShard("chat_connections", "gauge", "Connections currently open.",
+             [](const ShardMetrics& s) { return s.connected.get(); });
+    perShard("chat_bytes_received_total", "counter", "Bytes read from client sockets.",
+             [](const ShardMetrics& s) { return s.bytes_in.get(); });
+    perShard("chat_bytes_sent_total", "counter", "Bytes written to client sockets.",
+             [](const ShardMetrics& s) { return s.bytes_out.get(); });
+    perShard("chat_store_dropped_total", "counter", "Chat lines the message store dropped (writer behind or line too large).",
+             [](const ShardMetrics& s) { return s.store_dropped.get(); });
+    perShard("chat_outbound_queued_bytes", "gauge", "In-memory bytes waiting in outbound queues.",
+             [](const ShardMetrics& s) { return s.outbound_bytes.get(); });
+    perShard("chat_mailbox_depth", "gauge", "Cross-shard envelopes waiting to be drained.",
+             [](const ShardMetrics& s) { return s.mailbox_depth.get(); });
+
+    appendHeader(out, "chat_log_dropped_total", "counter", "Log lines dropped because the log queue was full.");
+    appendSample(out, "chat_log_dropped_total", "", std::to_string(logger.droppedCount()));
+
+    // Per-handler series are summed over shards
+    appendHeader(out, "chat_commands_total", "counter", "Frames handled, by handler.");
+    for (size_t h = 0; h < handler_names.size(); ++h) {
+        uint64_t total = 0;
+        for (const auto& shard : shards) total += shard->handled[h].get();
+        appendSample(out, "chat_commands_total", "command=\"" + handler_names[h] + "\"", std::to_string(total));
+    }
+
+    appendHeader(out, "chat_command_duration_seconds", "histogram", "Time spent in each handler.");
+    for (size_t h = 0; h < handler_names.size(); ++h) {
+        LatencyHistogram merged;
+        for (const auto& shard : shards) shard->handler_latency[h].snapshotInto(merged);
+        appendHistogram(out, "chat_command_duration_seconds", "command=\"" + handler_names[h] + "\"", merged);
+    }
+
+    appendHeader(out, "chat_loop_iteration_seconds", "histogram", "Reactor time per epoll pass that had events.");
+    LatencyHistogram loop;
+    for (const auto& shard : shards) shard->loop_iteration.snapshotInto(loop);
+    appendHistogram(out, "chat_loop_iteration_seconds", "", loop);
+
+    return out;
+}
+
+StatsSocket::StatsSocket(const std::string& path, const Metrics& metrics)
+    : path(path), metrics(metrics) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::fprintf(stderr, "admin_socket path too long: %s\n", path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) { perror("admin socket"); exit(EXIT_FAILURE); }
+
+    // A stale socket file from a previous run would make bind() fail
+    unlink(path.c_str());
+    if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) == -1) { perror("admin bind"); exit(EXIT_FAILURE); }
+    if (listen(listen_fd, 16) == -1) { perror("admin listen"); exit(EXIT_FAILURE); }
+
+    server = std::thread([this]() { serve(); });
+}
+
+StatsSocket::~StatsSocket() {
+    stopping.store(true);
+    shutdown(listen_fd, SHUT_RDWR);  // wakes the blocked accept()
+    server.join();
+    close(listen_fd);
+    unlink(path.c_str());
+}
+
+void StatsSocket::serve() {
+    while (!stopping.load()) {
+        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (!stopping.load()) perror("admin accept");
+            return;
+        }
+        answer(client_fd);
+        close(client_fd);
+    }
+}
+
+void StatsSocket::answer(int client_fd) {
+    // A plain connect-and-read client sends nothing; wait briefly for a request
+    timeval timeout{0, REQUEST_TIMEOUT_MS * 1000};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char request[512];
+    ssize_t n = recv(client_fd, request, sizeof(request), 0);
+
+    std::string body = metrics.render();
+    std::string reply;
+    if (n >= 4 && std::memcmp(request, "GET ", 4) == 0) {
+        reply = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+    }
+    reply += body;
+
+    const char* data = reply.data();
+    size_t left = reply.size();
+    while (left > 0) {
+        ssize_t sent = send(client_fd, data, left, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return;
+        data += sent;
+        left -= sent;
+    }
+}
+
+} // namespace ChatServer
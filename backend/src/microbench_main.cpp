@@ -0,0 +1,123 @@
+#include "message.hpp"
+#include "server.hpp"
+#include "utils.hpp"
+#include "buffer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every heap allocation in the process goes through here so each benchmark
+// can report allocations/op alongside ns/op
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Keep the optimizer from discarding a result it thinks is unused
+template <typename T>
+inline void keep(T const& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template <typename Fn>
+void bench(const char* name, Fn&& fn) {
+    constexpr int WARMUP = 10000;
+    for (int i = 0; i < WARMUP; ++i) fn();
+
+    // Grow the batch until one run takes long enough to time reliably
+    uint64_t iterations = 1000;
+    while (true) {
+        uint64_t allocs_before = allocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) fn();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        uint64_t allocs = allocations.load(std::memory_order_relaxed) - allocs_before;
+
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+        if (ns > 2e8 || iterations >= (1ull << 30)) {
+            std::printf("%-28s %10.1f ns/op %8.2f allocs/op  (%llu ops)\n", name, ns / iterations,
+                        (double)allocs / iterations, (unsigned long long)iterations);
+            return;
+        }
+        iterations *= 4;
+    }
+}
+
+// What handleClientMessage does with a frame before dispatching it
+const ChatServer::Server::Command* parseCommand(std::string_view frame) {
+    std::string_view msg = ChatServer::trimView(frame);
+    if (msg.empty() || msg[0] != '/') return nullptr;
+    auto [name, args] = ChatServer::splitToken(msg.substr(1));
+    keep(args);
+    return ChatServer::Server::findCommand(name);
+}
+
+} // namespace
+
+int main() {
+    using namespace ChatServer;
+
+    Message message{MessageType::GROUP, "alice", "engineering", "hello everyone, how is it going?"};
+    std::string wire = message.serialize();
+
+    bench("Message::serialize", [&]() {
+        std::string out = message.serialize();
+        keep(out);
+    });
+    std::string out;
+    bench("Message::appendTo (reused)", [&]() {
+        out.clear();
+        message.appendTo(out);
+        keep(out);
+    });
+    bench("Message::decode", [&]() {
+        Message parsed;
+        size_t frame_size;
+        Message::decode(wire, 4096, parsed, frame_size);
+        keep(parsed);
+    });
+
+    const std::string padded = "   /msg bob hello there, long time no see   \r";
+    bench("trim (copying)", [&]() {
+        std::string out = trim(padded);
+        keep(out);
+    });
+    bench("trimView", [&]() {
+        std::string_view out = trimView(padded);
+        keep(out);
+    });
+
+    const std::vector<std::string> frames = {
+        "/msg bob hello there",
+        "/gmsg team standup in five",
+        "/listgroups",
+        "/sendfile bob notes.txt 1024",
+        "/unknown command",
+        "just some chat text",
+    };
+    size_t next = 0;
+    bench("command parse + lookup", [&]() {
+        const Server::Command* cmd = parseCommand(frames[next]);
+        keep(cmd);
+        if (++next == frames.size()) next = 0;
+    });
+
+    const std::string group = "engineering", sender = "alice", text = "deploy is done, please verify";
+    bench("group fan-out line", [&]() {
+        SharedBuffer line = makeBuffer("[Group " + group + "] " + sender + ": " + text);
+        keep(line);
+    });
+
+    return 0;
+}
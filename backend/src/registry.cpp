@@ -0,0 +1,311 @@
+#include "registry.hpp"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <limits>
+#include <mutex>
+#include "config.hpp"
+
+namespace ChatServer {
+
+// Sorted-vector set helpers for member/admin lists and per-user group lists
+static bool containsId(const std::vector<uint32_t>& ids, uint32_t id) {
+    return std::binary_search(ids.begin(), ids.end(), id);
+}
+
+static void insertId(std::vector<uint32_t>& ids, uint32_t id) {
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it == ids.end() || *it != id) ids.insert(it, id);
+}
+
+static void eraseId(std::vector<uint32_t>& ids, uint32_t id) {
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it != ids.end() && *it == id) ids.erase(it);
+}
+
+Registry::Registry(size_t shard_count) : shards(shard_count, nullptr) {}
+
+void Registry::attachShard(int index, Server* shard) {
+    shards[index] = shard;
+}
+
+UserId Registry::internLocked(const std::string& username) {
+    UserId next = free_users.empty() ? (UserId)users.size() : free_users.back();
+    auto [it, inserted] = user_ids.emplace(username, next);
+    if (!inserted) return it->second;
+
+    if (next == users.size()) users.emplace_back();
+    else free_users.pop_back();
+    users[next].name = username;
+    return next;
+}
+
+// Forget a name nothing refers to any more: offline, off the /list and in no
+// group. Otherwise every fresh login name would stay interned for good.
+void Registry::reclaimIfUnused(UserId user) {
+    UserRecord& record = users[user];
+    if (record.online || record.presence != NOT_LISTED || !record.groups.empty()) return;
+    user_ids.erase(record.name);
+    record = UserRecord{};
+    free_users.push_back(user);
+}
+
+std::optional<UserId> Registry::lookupLocked(const std::string& username) const {
+    auto it = user_ids.find(username);
+    if (it == user_ids.end()) return std::nullopt;
+    return it->second;
+}
+
+static time_t now() {
+    return std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+}
+
+void Registry::setPresence(UserId user, PresenceState state, time_t at) {
+    UserRecord& record = users[user];
+    if (record.presence == NOT_LISTED) {
+        record.presence = presence.size();
+        presence.push_back({user, state, at});
+    } else {
+        presence[record.presence] = {user, state, at};
+    }
+    if (state == PresenceState::OFFLINE && ChatConfig::OFFLINE_RETENTION >= 0) offline_queue.push_back({user, at});
+    list_cache.reset();
+}
+
+// Drop offline entries older than the retention. Queue entries for users who
+// came back online (or went offline again later) are stale and just skipped.
+void Registry::evictOffline(time_t at) {
+    time_t retention = ChatConfig::OFFLINE_RETENTION / 1000;
+    list_expires = std::numeric_limits<time_t>::max();
+    if (ChatConfig::OFFLINE_RETENTION < 0) return;
+
+    while (!offline_queue.empty()) {
+        OfflineEntry entry = offline_queue.front();
+        UserRecord& record = users[entry.user];
+        bool current = record.presence != NOT_LISTED && presence[record.presence].state == PresenceState::OFFLINE &&
+                       presence[record.presence].since == entry.since;
+        if (current && entry.since + retention > at) {
+            list_expires = entry.since + retention;
+            return;
+        }
+        offline_queue.pop_front();
+        if (!current) continue;
+
+        // Swap-remove from the packed list
+        uint32_t slot = record.presence;
+        presence[slot] = presence.back();
+        users[presence[slot].user].presence = slot;
+        presence.pop_back();
+        record.presence = NOT_LISTED;
+        list_cache.reset();
+        reclaimIfUnused(entry.user);
+    }
+}
+
+std::optional<UserLocation> Registry::login(const std::string& username, UserLocation loc, UserId& user) {
+    // Interned under the same lock, so the id can't be reclaimed in between
+    std::unique_lock lock(mutex);
+    user = internLocked(username);
+    UserRecord& record = users[user];
+    std::optional<UserLocation> previous;
+    if (record.online) previous = record.loc;
+
+    record.online = true;
+    record.loc = loc;
+    for (size_t i = 0; i < record.groups.size(); ++i) {
+        // Already listed (logged in elsewhere): just point the entries at the new connection
+        if (!previous) {
+            joinOnline(user, i);
+            continue;
+        }
+        Group& grp = groups[record.groups[i]];
+        grp.online[record.online_slots[i]].loc = loc;
+        onlineChanged(grp);
+    }
+    setPresence(user, PresenceState::ONLINE, now());
+    return previous;
+}
+
+void Registry::logout(UserId user, UserLocation loc) {
+    std::unique_lock lock(mutex);
+    UserRecord& record = users[user];
+    // A newer login may already own this name on another connection
+    if (!record.online || record.loc.shard != loc.shard || record.loc.fd != loc.fd) return;
+
+    record.online = false;
+    for (size_t i = 0; i < record.groups.size(); ++i) leaveOnline(user, i);
+    setPresence(user, PresenceState::OFFLINE, now());
+}
+
+std::optional<Route> Registry::find(const std::string& username) const {
+    std::shared_lock lock(mutex);
+    auto id = lookupLocked(username);
+    if (!id || !users[*id].online) return std::nullopt;
+    return Route{*id, users[*id].loc};
+}
+
+void Registry::evictOfflineNow() {
+    std::unique_lock lock(mutex);
+    evictOffline(now());
+}
+
+SharedBuffer Registry::onlineList() {
+    time_t at = now();
+    {
+        std::shared_lock lock(mutex);
+        if (list_cache && at < list_expires) return list_cache;
+    }
+
+    std::unique_lock lock(mutex);
+    evictOffline(at);
+    if (list_cache) return list_cache;
+
+    std::string list_text = "Online users:\n";
+    for (const Presence& entry : presence) {
+        // ctime() layout, without its static buffer
+        tm local;
+        char since[32];
+        localtime_r(&entry.since, &local);
+        std::strftime(since, sizeof(since), "%a %b %e %H:%M:%S %Y", &local);
+
+        list_text += users[entry.user].name;
+        list_text += entry.state == PresenceState::ONLINE ? " (online since " : " (offline since ";
+        list_text += since;
+        list_text += ")\n";
+    }
+    list_cache = makeBuffer(std::move(list_text));
+    return list_cache;
+}
+
+GroupStatus Registry::createGroup(const std::string& group, UserId creator) {
+    std::unique_lock lock(mutex);
+    auto [it, inserted] = group_ids.emplace(group, (GroupId)groups.size());
+    if (!inserted) return GroupStatus::EXISTS;
+    groups.push_back(Group{group, {}, {creator}, {}, nullptr});
+    linkMember(it->second, creator);
+    return GroupStatus::OK;
+}
+
+GroupStatus Registry::addMember(const std::string& group, UserId admin, const std::string& user) {
+    std::unique_lock lock(mutex);
+    auto git = group_ids.find(group);
+    if (git == group_ids.end()) return GroupStatus::NO_GROUP;
+    Group& grp = groups[git->second];
+    if (!containsId(grp.admins, admin)) return GroupStatus::NOT_ADMIN;
+    // Members may be added before they ever log in
+    linkMember(git->second, internLocked(user));
+    return GroupStatus::OK;
+}
+
+GroupStatus Registry::kickMember(const std::string& group, UserId admin, const std::string& user) {
+    std::unique_lock lock(mutex);
+    auto git = group_ids.find(group);
+    if (git == group_ids.end()) return GroupStatus::NO_GROUP;
+    Group& grp = groups[git->second];
+    if (!containsId(grp.admins, admin)) return GroupStatus::NOT_ADMIN;
+    auto id = lookupLocked(user);
+    if (!id || !containsId(grp.members, *id)) return GroupStatus::NOT_MEMBER;
+    unlinkMember(git->second, *id);
+    reclaimIfUnused(*id);
+    return GroupStatus::OK;
+}
+
+// Membership lives in three places kept in step: the group's member list,
+// the user's group list, and (while online) the group's online list
+void Registry::linkMember(GroupId group, UserId user) {
+    UserRecord& record = users[user];
+    auto it = std::lower_bound(record.groups.begin(), record.groups.end(), group);
+    if (it != record.groups.end() && *it == group) return;
+
+    size_t index = it - record.groups.begin();
+    insertId(groups[group].members, user);
+    record.groups.insert(it, group);
+    record.online_slots.insert(record.online_slots.begin() + index, 0);
+    if (record.online) joinOnline(user, index);
+}
+
+void Registry::unlinkMember(GroupId group, UserId user) {
+    UserRecord& record = users[user];
+    auto it = std::lower_bound(record.groups.begin(), record.groups.end(), group);
+    if (it == record.groups.end() || *it != group) return;
+
+    size_t index = it - record.groups.begin();
+    if (record.online) leaveOnline(user, index);
+    eraseId(groups[group].members, user);
+    eraseId(groups[group].admins, user);
+    record.groups.erase(it);
+    record.online_slots.erase(record.online_slots.begin() + index);
+}
+
+void Registry::joinOnline(UserId user, size_t index) {
+    UserRecord& record = users[user];
+    Group& grp = groups[record.groups[index]];
+    record.online_slots[index] = grp.online.size();
+    grp.online.push_back({user, record.loc});
+    onlineChanged(grp);
+}
+
+void Registry::leaveOnline(UserId user, size_t index) {
+    UserRecord& record = users[user];
+    GroupId id = record.groups[index];
+    Group& grp = groups[id];
+
+    // Swap-remove, then repoint the member that moved into the hole
+    uint32_t slot = record.online_slots[index];
+    grp.online[slot] = grp.online.back();
+    grp.online.pop_back();
+    onlineChanged(grp);
+    if (slot == grp.online.size()) return;
+    UserRecord& moved = users[grp.online[slot].user];
+    auto it = std::lower_bound(moved.groups.begin(), moved.groups.end(), id);
+    moved.online_slots[it - moved.groups.begin()] = slot;
+}
+
+std::string Registry::renderGroupsOf(UserId user) const {
+    std::shared_lock lock(mutex);
+    std::string response = "Groups you are in:\n";
+    for (GroupId id : users[user].groups) {
+        const Group& grp = groups[id];
+        response += grp.name + " (Admins: ";
+        for (UserId admin : grp.admins) response += users[admin].name + " ";
+        response += ")\nMembers: ";
+        for (UserId mem : grp.members) response += users[mem].name + " ";
+        response += "\n";
+    }
+    return response;
+}
+
+std::vector<std::pair<GroupId, std::string>> Registry::groupsOf(UserId user) const {
+    std::shared_lock lock(mutex);
+    std::vector<std::pair<GroupId, std::string>> result;
+    for (GroupId id : users[user].groups) result.emplace_back(id, groups[id].name);
+    return result;
+}
+
+GroupStatus Registry::memberGroup(const std::string& group, UserId member, GroupId& id) const {
+    std::shared_lock lock(mutex);
+    auto git = group_ids.find(group);
+    if (git == group_ids.end()) return GroupStatus::NO_GROUP;
+    if (!containsId(groups[git->second].members, member)) return GroupStatus::NOT_MEMBER;
+    id = git->second;
+    return GroupStatus::OK;
+}
+
+GroupStatus Registry::groupRecipients(const std::string& group, UserId sender, RouteList& out, GroupId& id) const {
+    std::shared_lock lock(mutex);
+    auto git = group_ids.find(group);
+    if (git == group_ids.end()) return GroupStatus::NO_GROUP;
+    const Group& grp = groups[git->second];
+    if (!containsId(grp.members, sender)) return GroupStatus::NOT_MEMBER;
+
+    out = std::atomic_load(&grp.online_view);
+    if (!out) {
+        // Two senders racing here build the same list; either copy will do
+        out = std::make_shared<const std::vector<Route>>(grp.online);
+        std::atomic_store(&grp.online_view, out);
+    }
+    id = git->second;
+    return GroupStatus::OK;
+}
+
+} // namespace ChatServer
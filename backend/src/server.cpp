@@ -11,446 +11,1793 @@
 #include <ctime>
 #include <csignal>
 #include <sstream>
-#include <filesystem>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <cerrno>
+#include <array>
+#include <charconv>
+#include "config.hpp"
+#include "utils.hpp"
 namespace ChatServer {
 
-// Helper to trim whitespace
-static std::string trim(const std::string& s) {
-    auto start = std::find_if_not(s.begin(), s.end(), ::isspace);
-    auto end   = std::find_if_not(s.rbegin(), s.rend(), ::isspace).base();
-    if (start >= end) return "";
-    return std::string(start, end);
+// Relay pipe capacity: how far an upload may run ahead of its receiver
+static constexpr int RELAY_PIPE_SIZE = 1 << 20;
+
+// Connection slots reserved up front, at most
+static constexpr size_t MAX_RESERVED_SLOTS = 1 << 16;
+
+// Timer wheel resolution
+static constexpr int TIMER_TICK_MS = 100;
+
+static uint64_t currentTick() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000) / TIMER_TICK_MS;
 }
 
-Server::Server() {
+static uint64_t ticksFor(int ms) {
+    return (ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+}
+
+// /history reply size when the in-memory ring is disabled, and the cap on store reads
+static constexpr size_t DEFAULT_HISTORY_LINES = 100;
+static constexpr size_t MAX_HISTORY_LINES = 1000;
+
+static uint64_t elapsedNs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+Server::Server(int shard_index, Registry& registry, Logger& logger, Metrics& metrics,
+               HistoryStore& history, MessageStore* store)
+    : shard_index(shard_index), registry(registry), logger(logger),
+      metrics(metrics), stats(metrics.shard(shard_index)), history(history), store(store),
+      edge_triggered(ChatConfig::EDGE_TRIGGERED),
+      client_events(EPOLLIN | EPOLLRDHUP | (ChatConfig::EDGE_TRIGGERED ? (uint32_t)EPOLLET : 0u)),
+      timers(currentTick()) {
     initServerSocket();
-    initEpoll();
+    initBackend();
+
+    // Slot table sized for the fds this process may open (up to a cap), so
+    // an accept storm doesn't keep reallocating it; reserve() only maps memory
+    rlimit files{};
+    size_t slots = MAX_RESERVED_SLOTS;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur != RLIM_INFINITY)
+        slots = std::min<size_t>(slots, files.rlim_cur);
+    connections.reserve(slots);
+    live_fds.reserve(slots);
+
+    if (ChatConfig::HOUSEKEEPING_INTERVAL > 0)
+        timers.schedule(ticksFor(ChatConfig::HOUSEKEEPING_INTERVAL), -1, (int)TimerKind::HOUSEKEEPING);
 }
 
 Server::~Server() {
     close(server_fd);
-    close(epoll_fd);
+    if (ws_fd != -1) close(ws_fd);
+    close(wake_fd);
+    close(timer_fd);
 }
 
 void Server::initServerSocket() {
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd == -1) { perror("socket"); exit(EXIT_FAILURE); }
+    server_fd = openListener(12345);
+    if (ChatConfig::WEBSOCKET_PORT > 0) ws_fd = openListener(ChatConfig::WEBSOCKET_PORT);
+}
+
+int Server::openListener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) { perror("socket"); exit(EXIT_FAILURE); }
 
+    // Every shard binds its own socket to the same port; the kernel spreads
+    // incoming connections across them.
     int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
 
+    sockaddr_in addr{};
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(12345);
-
-    if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); exit(EXIT_FAILURE); }
-    if (listen(server_fd, SOMAXCONN) < 0) { perror("listen"); exit(EXIT_FAILURE); }
+    addr.sin_port = htons(port);
 
-    fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL, 0) | O_NONBLOCK);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); exit(EXIT_FAILURE); }
+    if (listen(fd, std::max(1, ChatConfig::BACKLOG)) < 0) { perror("listen"); exit(EXIT_FAILURE); }
 
-    std::cout << "Starting Chat Server on port " << ntohs(addr.sin_port) << "...\n";
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
 }
 
-void Server::initEpoll() {
-    epoll_fd = epoll_create1(0);
-    if (epoll_fd == -1) { perror("epoll_create1"); exit(EXIT_FAILURE); }
+void Server::initBackend() {
+    io = makeIoBackend(ChatConfig::IO_BACKEND, std::max(1, ChatConfig::MAX_EVENTS), std::max(1, ChatConfig::BUFFER_SIZE));
+    completion_reads = io->completesReads();
+    if (shard_index == 0) std::cout << "I/O backend: " << io->name() << std::endl;
 
-    epoll_event ev;
-    ev.events = EPOLLIN;
-    ev.data.fd = server_fd;
-    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev) == -1) { perror("epoll_ctl"); exit(EXIT_FAILURE); }
+    // io_uring accepts on its own; with epoll the listening socket reports readable
+    if (!io->acceptMultishot(server_fd)) io->add(server_fd, edge_triggered ? (EPOLLIN | EPOLLET) : EPOLLIN);
+    // Level-triggered either way, so it never needs accept_pending
+    if (ws_fd != -1 && !io->acceptMultishot(ws_fd)) io->add(ws_fd, EPOLLIN);
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd == -1) { perror("eventfd"); exit(EXIT_FAILURE); }
+    io->add(wake_fd, EPOLLIN);
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1) { perror("timerfd_create"); exit(EXIT_FAILURE); }
+    itimerspec tick{};
+    tick.it_interval.tv_nsec = TIMER_TICK_MS * 1000000L;
+    tick.it_value = tick.it_interval;
+    if (timerfd_settime(timer_fd, 0, &tick, nullptr) == -1) { perror("timerfd_settime"); exit(EXIT_FAILURE); }
+    io->add(timer_fd, EPOLLIN);
 }
 
 void Server::run() {
-    constexpr int MAX_EVENTS = 10;
-    epoll_event events[MAX_EVENTS];
+    std::vector<IoEvent> events;
+    std::vector<int> resume;
 
-    while (true) {
-        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
-        if (nfds == -1) { perror("epoll_wait"); continue; }
+    while (!stopping.load(std::memory_order_relaxed)) {
+        // Don't sleep while budget-limited sockets still have input waiting
+        int timeout = (pending_reads.empty() && !accept_pending) ? ChatConfig::EPOLL_TIMEOUT : 0;
+        events.clear();
+        io->wait(events, timeout);
+        auto pass_start = std::chrono::steady_clock::now();
+
+        for (const IoEvent& event : events) {
+            int fd = event.fd;
+            // Completions (io_uring): the backend already did the I/O
+            if (event.kind == IoEvent::Kind::ACCEPTED) { acceptConnection(event.result, fd == ws_fd); continue; }
+            if (event.kind == IoEvent::Kind::RECEIVED) { handleReceived(fd, event.data, event.result); continue; }
+            if (event.kind == IoEvent::Kind::SENT) { handleSendDone(fd, event.tag, event.result); continue; }
+
+            if (fd == server_fd || fd == ws_fd) handleNewConnection(fd);
+            else if (fd == wake_fd) drainMailbox();
+            else if (fd == timer_fd) handleTimers();
+            else if (findConnection(fd)) {
+                uint32_t ready = event.events;
+                if (ready & EPOLLOUT) flushOutbound(fd);
+                Connection* conn = findConnection(fd);
+                if (!conn) continue;
+                // A sender paused on a full relay pipe only listens for hard errors
+                if (conn->read_paused) { if (ready & (EPOLLHUP | EPOLLERR)) removeClient(fd); }
+                else if (ready & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) handleClientInput(fd);
+            }
+            else handlePipeReady(fd);
+        }
 
-        for (int i = 0; i < nfds; ++i) {
-            if (events[i].data.fd == server_fd) handleNewConnection();
-            else handleClientMessage(events[i].data.fd);
+        // Edge-triggered: continue sockets that hit their read budget last pass
+        if (accept_pending) handleNewConnection(server_fd);
+        resume.swap(pending_reads);
+        for (int fd : resume) {
+            Connection* conn = findConnection(fd);
+            if (!conn) continue;
+            conn->read_pending = false;
+            handleClientInput(fd);
         }
+        resume.clear();
+
+        if (!events.empty()) stats.loop_iteration.record(elapsedNs(pass_start));
     }
 }
 
-void Server::handleNewConnection() {
-    sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-    if (client_fd == -1) { perror("accept"); return; }
+void Server::handleNewConnection(int listen_fd) {
+    // Accept until EAGAIN, capped so a connection storm can't starve existing
+    // clients. accept4() hands back sockets already non-blocking.
+    int budget = std::max(1, ChatConfig::MAX_ACCEPTS_PER_EVENT);
+    bool websocket = listen_fd == ws_fd;
+    if (!websocket) accept_pending = false;
 
-    fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL, 0) | O_NONBLOCK);
+    for (int accepted = 0; accepted < budget; ++accepted) {
+        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && consoleAllowed()) perror("accept4");
+            return;
+        }
+        acceptConnection(client_fd, websocket);
+    }
 
-    epoll_event ev;
-    ev.events = EPOLLIN;
-    ev.data.fd = client_fd;
-    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
+    // Level-triggered epoll reports the rest again by itself
+    if (edge_triggered && !websocket) accept_pending = true;
+}
 
-    clients[client_fd] = ""; // username not yet set
-    std::cout << "New client connected: " << client_fd << std::endl;
+// Register a freshly accepted, non-blocking socket and give it a slot
+void Server::acceptConnection(int client_fd, bool websocket) {
+    io->addStream(client_fd, client_events);
+
+    if ((size_t)client_fd >= connections.size()) connections.resize(client_fd + 1);
+    Connection& conn = connections[client_fd];
+    conn.open = true; // username not yet set
+    if (websocket) {
+        conn.ws = std::make_unique<WebSocketState>();
+        conn.framing = Framing::WEBSOCKET;
+    }
+    conn.live_index = live_fds.size();
+    conn.last_active = timers.now();
+    armTimer(conn.idle_timer, client_fd, TimerKind::IDLE, ChatConfig::CLIENT_INACTIVITY_TIMEOUT);
+    live_fds.push_back(client_fd);
+    stats.accepted.add();
+    stats.connected.add(1);
+    if (consoleAllowed()) std::cout << "New client connected: " << client_fd << " (shard " << shard_index << ")" << std::endl;
+}
+
+// Connection and store-drop lines on the console: at most
+// CONSOLE_LINES_PER_SECOND per shard, so a reconnect storm isn't paced by
+// terminal writes. The rest are only counted.
+bool Server::consoleAllowed() {
+    rollConsoleWindow();
+    if (console_lines < CONSOLE_LINES_PER_SECOND) {
+        ++console_lines;
+        return true;
+    }
+    ++console_suppressed;
+    return false;
+}
+
+void Server::rollConsoleWindow() {
+    if (timers.now() - console_window < ticksFor(1000)) return;
+    if (console_suppressed > 0)
+        std::cout << "(" << console_suppressed << " console messages suppressed on shard " << shard_index << ")" << std::endl;
+    console_window = timers.now();
+    console_lines = 0;
+    console_suppressed = 0;
 }
 
 void Server::logMessage(const std::string& msg) {
-    std::ofstream log("chat.log", std::ios::app);
-    if (log.is_open()) {
-        log << msg << std::endl;
+    logger.log(msg);
+}
+
+// Main room and group lines go to the message store when there is one
+void Server::recordChat(std::string_view channel, const std::string& line) {
+    if (!store) {
+        logMessage(line);
+        return;
+    }
+    if (store->append(channel, line)) return;
+    stats.store_dropped.add();
+    if (consoleAllowed()) std::cerr << "Message store dropped a line (" << stats.store_dropped.get() << " on shard " << shard_index << ")" << std::endl;
+}
+
+void Server::handleClientInput(int client_fd) {
+    // io_uring receives on its own; only what is already buffered is left to handle
+    if (completion_reads) {
+        handleInbound(client_fd);
+        return;
+    }
+
+    // Level-triggered: one read per wakeup. Edge-triggered: read until EAGAIN,
+    // but at most MAX_READS_PER_EVENT reads before yielding to other sockets.
+    int budget = edge_triggered ? ChatConfig::MAX_READS_PER_EVENT : 1;
+
+    for (int reads = 0; reads < budget; ++reads) {
+        Connection* slot = findConnection(client_fd);
+        if (!slot) return;
+        // Mid-upload the socket belongs to the relay until the declared size is through
+        if (slot->upload && !pumpUpload(client_fd)) {
+            // A WebSocket upload copies unwrapped bytes; once they run out, read more
+            slot = findConnection(client_fd);
+            if (!slot || !slot->ws || !slot->inbound.empty()) return;
+        }
+        slot = findConnection(client_fd);
+        if (!slot) return;
+        Connection& conn = *slot;
+
+        ByteBuffer& input = conn.ws ? conn.ws->raw : conn.inbound;
+        char* dst = input.prepare(ChatConfig::BUFFER_SIZE);
+        ssize_t bytes_read = read(client_fd, dst, ChatConfig::BUFFER_SIZE);
+        if (bytes_read < 0 && errno == EINTR) continue;
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (bytes_read <= 0) {
+            if (!conn.username.empty()) logMessage("Client disconnected: " + conn.username);
+            removeClient(client_fd);
+            return;
+        }
+        input.commit(bytes_read);
+        conn.last_active = timers.now();
+        stats.bytes_in.add(bytes_read);
+        handleInbound(client_fd);
+
+        // A short read means the socket is drained; a new arrival is a new edge
+        if (bytes_read < ChatConfig::BUFFER_SIZE) return;
+    }
+
+    // Budget spent with input possibly left: resume after this epoll pass
+    Connection* conn = findConnection(client_fd);
+    if (edge_triggered && conn && !conn->read_pending) {
+        conn->read_pending = true;
+        pending_reads.push_back(client_fd);
     }
 }
 
-void Server::handleClientMessage(int client_fd) {
-    char buffer[1024];
-    int bytes_read = read(client_fd, buffer, sizeof(buffer));
-    if (bytes_read <= 0) {
-        if (!clients[client_fd].empty()) logMessage("Client disconnected: " + clients[client_fd]);
+// Bytes the io_uring backend received on the loop's behalf (0: EOF, <0: -errno)
+void Server::handleReceived(int client_fd, const char* data, int result) {
+    Connection* conn = findConnection(client_fd);
+    if (!conn) return;
+    if (result <= 0) {
+        if (!conn->username.empty()) logMessage("Client disconnected: " + conn->username);
         removeClient(client_fd);
         return;
     }
+    (conn->ws ? conn->ws->raw : conn->inbound).append(data, result);
+    conn->last_active = timers.now();
+    stats.bytes_in.add(result);
+    handleClientInput(client_fd);
+}
+
+// Bytes reached user space: WebSocket frames are unwrapped first, an upload in
+// progress takes its share, and then every complete frame is handled
+void Server::handleInbound(int client_fd) {
+    Connection* conn = findConnection(client_fd);
+    if (conn && conn->ws && !unwrapWebSocket(client_fd)) return;
+    conn = findConnection(client_fd);
+    if (!conn || (conn->upload && !pumpUpload(client_fd))) return;
+    handleFrames(client_fd);
+}
+
+// Turn what a WebSocket peer sent into the stream a LINE client would have
+// written (the same thing bridge.js did): text messages become '\n'-terminated
+// lines and binary ones, i.e. /sendfile data, pass through as-is. Control
+// frames are answered here. False if the connection was closed.
+bool Server::unwrapWebSocket(int client_fd) {
+    Connection& conn = connections[client_fd];
+    WebSocketState& ws = *conn.ws;
+
+    if (!ws.open) {
+        std::string_view key;
+        size_t request_size = 0;
+        switch (parseUpgradeRequest({ws.raw.data(), ws.raw.size()}, key, request_size)) {
+        case WebSocketFrame::Decode::INCOMPLETE:
+            return true;
+        case WebSocketFrame::Decode::INVALID:
+            sendRaw(client_fd, makeBuffer(UPGRADE_REJECTED));
+            removeClient(client_fd);
+            return false;
+        case WebSocketFrame::Decode::OK:
+            break;
+        }
+        sendRaw(client_fd, makeBuffer(upgradeResponse(key)));
+        ws.raw.consume(request_size);
+        ws.open = true;
+    }
+
+    while (!ws.raw.empty()) {
+        // Payload of the current data frame, unmasked straight into inbound
+        if (ws.payload_left > 0) {
+            size_t n = std::min<uint64_t>(ws.payload_left, ws.raw.size());
+            char* dst = conn.inbound.prepare(n);
+            std::memcpy(dst, ws.raw.data(), n);
+            WebSocketFrame::unmask(dst, n, ws.mask, ws.payload_offset);
+            conn.inbound.commit(n);
+            ws.raw.consume(n);
+            ws.payload_left -= n;
+            ws.payload_offset += n;
+            if (ws.payload_left == 0 && ws.final_frame && ws.text) conn.inbound.append("\n", 1);
+            continue;
+        }
+
+        WebSocketFrame frame;
+        switch (WebSocketFrame::decodeHeader({ws.raw.data(), ws.raw.size()}, frame)) {
+        case WebSocketFrame::Decode::INCOMPLETE:
+            return true;
+        case WebSocketFrame::Decode::INVALID:
+            closeWebSocket(client_fd, "\x03\xEA");  // 1002: protocol error
+            return false;
+        case WebSocketFrame::Decode::OK:
+            break;
+        }
+
+        if (frame.isControl()) {
+            if (ws.raw.size() < frame.header_size + frame.length) return true;
+            char payload[WebSocketFrame::MAX_CONTROL];
+            std::memcpy(payload, ws.raw.data() + frame.header_size, frame.length);
+            WebSocketFrame::unmask(payload, frame.length, frame.mask, 0);
+            ws.raw.consume(frame.header_size + frame.length);
+            if (frame.opcode == WebSocketFrame::PING) {
+                sendControl(client_fd, WebSocketFrame::PONG, {payload, frame.length});
+            } else if (frame.opcode == WebSocketFrame::CLOSE) {
+                // Echo the status code back, then hang up
+                closeWebSocket(client_fd, {payload, std::min<size_t>(frame.length, 2)});
+                return false;
+            }
+            continue;
+        }
+
+        // A message is one TEXT or BINARY frame plus any CONTINUATION frames
+        if ((frame.opcode == WebSocketFrame::CONTINUATION) != ws.in_message) {
+            closeWebSocket(client_fd, "\x03\xEA");
+            return false;
+        }
+        if (frame.opcode != WebSocketFrame::CONTINUATION) ws.text = frame.opcode == WebSocketFrame::TEXT;
+        ws.in_message = !frame.fin;
+        ws.final_frame = frame.fin;
+        ws.mask = frame.mask;
+        ws.payload_left = frame.length;
+        ws.payload_offset = 0;
+        ws.raw.consume(frame.header_size);
+        if (frame.length == 0 && frame.fin && ws.text) conn.inbound.append("\n", 1);
+    }
+    return true;
+}
+
+// Send a close frame with `status` (two bytes, or none) and drop the connection
+void Server::closeWebSocket(int client_fd, std::string_view status) {
+    sendControl(client_fd, WebSocketFrame::CLOSE, status);
+    removeClient(client_fd);
+}
+
+// Handle every complete frame now; a partial one waits for more input
+void Server::handleFrames(int client_fd) {
+    while (true) {
+        Connection* conn = findConnection(client_fd);
+        if (!conn) return;
+        if (conn->framing == Framing::MESSAGE) {
+            Message message;
+            if (!nextMessage(client_fd, *conn, message)) return;
+            handleMessage(client_fd, message);
+            continue;
+        }
+        if (conn->framing == Framing::GATEWAY) {
+            GatewayFrame frame;
+            std::string_view payload;
+            if (!nextGatewayFrame(client_fd, *conn, frame, payload)) return;
+            handleGatewayFrame(client_fd, frame, payload);
+            continue;
+        }
+        if (!nextFrame(client_fd, *conn, frame_scratch)) return;
+        std::string_view msg = trimView(frame_scratch);
+        if (!msg.empty()) handleClientMessage(client_fd, msg);
+    }
+}
+
+bool Server::nextFrame(int client_fd, Connection& conn, std::string& frame) {
+    const size_t max_len = ChatConfig::MAX_MESSAGE_LEN;
+
+    while (!conn.inbound.empty()) {
+        if (conn.skip_bytes > 0) {
+            size_t n = std::min(conn.skip_bytes, conn.inbound.size());
+            conn.inbound.consume(n);
+            conn.skip_bytes -= n;
+            continue;
+        }
+
+        if (conn.framing == Framing::LENGTH) {
+            if (conn.inbound.size() < 4) return false;
+            uint32_t len;
+            std::memcpy(&len, conn.inbound.data(), 4);
+            len = ntohl(len);
+            if (len > max_len) {
+                sendError(client_fd, "Error: Message too long.");
+                conn.inbound.consume(4);
+                conn.skip_bytes = len;
+                continue;
+            }
+            if (conn.inbound.size() < 4 + len) return false;
+            frame.assign(conn.inbound.data() + 4, len);
+            conn.inbound.consume(4 + len);
+            return true;
+        }
+
+        const char* begin = conn.inbound.data();
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', conn.inbound.size()));
+        if (!newline) {
+            if (conn.inbound.size() > max_len) {
+                if (!conn.skip_line) sendError(client_fd, "Error: Message too long.");
+                conn.inbound.clear();
+                conn.skip_line = true;
+            }
+            return false;
+        }
+
+        size_t line_len = newline - begin;
+        if (conn.skip_line || line_len > max_len) {
+            if (!conn.skip_line) sendError(client_fd, "Error: Message too long.");
+            conn.inbound.consume(line_len + 1);
+            conn.skip_line = false;
+            continue;
+        }
+        frame.assign(begin, line_len);
+        conn.inbound.consume(line_len + 1);
+        return true;
+    }
+    return false;
+}
+
+// Decode the next Message in place. The frame is consumed, but its bytes stay
+// put (and `message` valid) until the next read into conn.inbound.
+bool Server::nextMessage(int client_fd, Connection& conn, Message& message) {
+    while (!conn.inbound.empty()) {
+        if (conn.skip_bytes > 0) {
+            size_t n = std::min(conn.skip_bytes, conn.inbound.size());
+            conn.inbound.consume(n);
+            conn.skip_bytes -= n;
+            continue;
+        }
+
+        size_t frame_size = 0;
+        std::string_view buffered(conn.inbound.data(), conn.inbound.size());
+        switch (Message::decode(buffered, ChatConfig::MAX_MESSAGE_LEN, message, frame_size)) {
+        case Message::Decode::OK:
+            conn.inbound.consume(frame_size);
+            return true;
+        case Message::Decode::INCOMPLETE:
+            return false;
+        case Message::Decode::TOO_LARGE:
+            sendError(client_fd, "Error: Message too long.");
+            break;
+        case Message::Decode::INVALID:
+            sendError(client_fd, "Error: Malformed message.");
+            break;
+        }
+        conn.skip_bytes = frame_size;
+    }
+    return false;
+}
+
+// Decode the next gateway frame in place, like nextMessage(): `payload` stays
+// valid until the next read into conn.inbound
+bool Server::nextGatewayFrame(int client_fd, Connection& conn, GatewayFrame& frame, std::string_view& payload) {
+    while (!conn.inbound.empty()) {
+        if (conn.skip_bytes > 0) {
+            size_t n = std::min(conn.skip_bytes, conn.inbound.size());
+            conn.inbound.consume(n);
+            conn.skip_bytes -= n;
+            continue;
+        }
+
+        if (!GatewayFrame::decodeHeader({conn.inbound.data(), conn.inbound.size()}, frame)) return false;
+        if (frame.length > GatewayFrame::MAX_PAYLOAD) {
+            sendError(client_fd, "Error: Gateway frame too long.");
+            conn.inbound.consume(GatewayFrame::HEADER_SIZE);
+            conn.skip_bytes = frame.length;
+            continue;
+        }
+        if (conn.inbound.size() < GatewayFrame::HEADER_SIZE + frame.length) return false;
+        payload = {conn.inbound.data() + GatewayFrame::HEADER_SIZE, frame.length};
+        conn.inbound.consume(GatewayFrame::HEADER_SIZE + frame.length);
+        return true;
+    }
+    return false;
+}
+
+// One frame from a gateway. Errors about the gateway's own frames go to session 0.
+void Server::handleGatewayFrame(int client_fd, const GatewayFrame& frame, std::string_view payload) {
+    switch (frame.op) {
+    case GatewayFrame::OPEN:
+        openSession(client_fd, frame.session, payload);
+        return;
+    case GatewayFrame::CLOSE:
+        closeSession(client_fd, frame.session);
+        return;
+    case GatewayFrame::OPEN_MANY:
+        // Bulk login: u32 session | u16 length | username, repeated
+        while (payload.size() >= 6) {
+            uint32_t id;
+            uint16_t len;
+            std::memcpy(&id, payload.data(), 4);
+            std::memcpy(&len, payload.data() + 4, 2);
+            len = ntohs(len);
+            if (payload.size() < 6u + len) break;
+            openSession(client_fd, ntohl(id), payload.substr(6, len));
+            payload.remove_prefix(6 + len);
+        }
+        if (!payload.empty()) sendError(client_fd, "Error: Malformed gateway frame.");
+        return;
+    case GatewayFrame::CLOSE_MANY:
+        for (; payload.size() >= 4; payload.remove_prefix(4)) {
+            uint32_t id;
+            std::memcpy(&id, payload.data(), 4);
+            closeSession(client_fd, ntohl(id));
+        }
+        if (!payload.empty()) sendError(client_fd, "Error: Malformed gateway frame.");
+        return;
+    case GatewayFrame::DATA:
+    case GatewayFrame::CREDIT:
+        break;
+    default:
+        sendError(client_fd, "Error: Unknown gateway frame.");
+        return;
+    }
+
+    Gateway& gateway = *connectionOf(client_fd).gateway;
+    auto it = gateway.sessions.find(frame.session);
+    if (it == gateway.sessions.end()) {
+        sendError(client_fd, "Error: No session " + std::to_string(frame.session) + ".");
+        return;
+    }
+    int session_fd = it->second;
+
+    if (frame.op == GatewayFrame::CREDIT) {
+        if (payload.size() != 4) { sendError(client_fd, "Error: Malformed gateway frame."); return; }
+        uint32_t bytes;
+        std::memcpy(&bytes, payload.data(), 4);
+        Connection& session = connectionOf(session_fd);
+        session.session->credit += ntohl(bytes);
+        releaseHeld(session);
+        return;
+    }
+
+    // One DATA frame is one line of the session's input
+    std::string_view msg = trimView(payload);
+    if (msg.size() > (size_t)ChatConfig::MAX_MESSAGE_LEN) sendError(session_fd, "Error: Message too long.");
+    else if (!msg.empty()) handleClientMessage(session_fd, msg);
+}
+
+// A new user on a gateway: a socket-less slot, logged in at once
+void Server::openSession(int gateway_fd, uint32_t id, std::string_view username) {
+    Gateway& gateway = *connectionOf(gateway_fd).gateway;
+    std::string name(trimView(username));
+    if (id == 0 || name.empty() || gateway.sessions.count(id)) {
+        sendError(gateway_fd, "Error: Cannot open session " + std::to_string(id) + ".");
+        return;
+    }
+
+    int index;
+    if (!free_sessions.empty()) {
+        index = free_sessions.back();
+        free_sessions.pop_back();
+    } else {
+        index = sessions.size();
+        sessions.emplace_back();
+    }
+    int session_fd = SESSION_BASE + index;
+    Connection& conn = sessions[index];
+    conn.open = true;
+    conn.live_index = live_fds.size();
+    conn.last_active = timers.now();
+    conn.session = std::make_unique<Session>(Session{gateway_fd, id, ChatConfig::GATEWAY_SESSION_WINDOW, {}});
+    live_fds.push_back(session_fd);
+    gateway.sessions.emplace(id, session_fd);
+
+    auto start = std::chrono::steady_clock::now();
+    handleLogin(session_fd, name);
+    recordHandler(HANDLER_LOGIN, start);
+}
+
+// The gateway logged a session out; no CLOSE goes back for it
+void Server::closeSession(int gateway_fd, uint32_t id) {
+    Gateway& gateway = *connectionOf(gateway_fd).gateway;
+    auto it = gateway.sessions.find(id);
+    if (it == gateway.sessions.end()) return;
+    int session_fd = it->second;
+    gateway.sessions.erase(it);
+    removeClient(session_fd);
+}
+
+namespace {
+
+// Start index of each first-letter bucket ('a'..'z') in a name-sorted command table
+template <typename Entry, size_t N>
+constexpr std::array<uint8_t, 27> bucketByFirstLetter(const Entry (&table)[N]) {
+    std::array<uint8_t, 27> start{};
+    size_t row = 0;
+    for (int letter = 0; letter < 26; ++letter) {
+        start[letter] = row;
+        while (row < N && table[row].name[0] == 'a' + letter) ++row;
+    }
+    start[26] = row;
+    return start;
+}
+
+template <typename Entry, size_t N>
+constexpr bool isSortedByName(const Entry (&table)[N]) {
+    for (size_t i = 1; i < N; ++i)
+        if (!(table[i - 1].name < table[i].name)) return false;
+    return true;
+}
+
+} // namespace
+
+const Server::CommandTable& Server::commandTable() {
+    // Keep sorted by name; the bucket index and static_asserts below depend on it
+    static constexpr Command rows[] = {
+        {"addmember",   &Server::cmdAddMember,   false},
+        {"creategroup", &Server::cmdCreateGroup, false},
+        {"framing",     &Server::cmdFraming,     true},
+        {"gateway",     &Server::cmdGateway,     true},
+        {"gmsg",        &Server::cmdGroupMessage, false},
+        {"help",        &Server::cmdHelp,        false},
+        {"history",     &Server::cmdHistory,     false},
+        {"kickmember",  &Server::cmdKickMember,  false},
+        {"list",        &Server::cmdList,        false},
+        {"listgroups",  &Server::cmdListGroups,  false},
+        {"msg",         &Server::cmdPrivateMessage, false},
+        {"sendfile",    &Server::cmdSendFile,    false},
+        {"stats",       &Server::cmdStats,       false},
+        {"whoami",      &Server::cmdWhoami,      false},
+    };
+    static_assert(std::size(rows) == COMMAND_COUNT, "COMMAND_COUNT must match the command table");
+    static_assert(isSortedByName(rows), "command table must be sorted by name");
+    static constexpr CommandTable table{rows, bucketByFirstLetter(rows)};
+    static_assert(table.buckets[26] == COMMAND_COUNT, "command names must start with a lowercase letter");
+    return table;
+}
+
+const Server::Command* Server::findCommand(std::string_view name) {
+    const CommandTable& table = commandTable();
+    if (name.empty() || name[0] < 'a' || name[0] > 'z') return nullptr;
+    int letter = name[0] - 'a';
+    for (size_t i = table.buckets[letter]; i < table.buckets[letter + 1]; ++i)
+        if (table.rows[i].name == name) return &table.rows[i];
+    return nullptr;
+}
+
+const Server::Command& Server::command(size_t index) {
+    return commandTable().rows[index];
+}
+
+// Metrics slot of a command by name
+static size_t handlerIndex(std::string_view name) {
+    return Server::findCommand(name) - &Server::command(0);
+}
+
+std::vector<std::string> Server::handlerNames() {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < COMMAND_COUNT; ++i) names.emplace_back(command(i).name);
+    names.emplace_back("chat");
+    names.emplace_back("login");
+    return names;
+}
+
+void Server::handleClientMessage(int client_fd, std::string_view msg) {
+    // Commands: "/name args"; anything else (including unknown commands) is chat
+    if (msg[0] == '/') {
+        auto [name, args] = splitToken(msg.substr(1));
+        if (runCommand(client_fd, name, args)) return;
+    }
+    handleText(client_fd, msg);
+}
 
-    std::string msg = trim(std::string(buffer, bytes_read));
-    std::string sender = clients[client_fd];
+// A MESSAGE-framed request: the type says what it is, so nothing is parsed out of text
+void Server::handleMessage(int client_fd, const Message& message) {
+    static const size_t MSG = handlerIndex("msg"), GMSG = handlerIndex("gmsg"), SENDFILE = handlerIndex("sendfile");
 
-    // First message = username
+    const std::string& sender = connectionOf(client_fd).username;
+    if (message.type == MessageType::TEXT) { handleText(client_fd, message.content); return; }
+    if (message.type == MessageType::COMMAND) {
+        auto [name, args] = splitToken(message.content);
+        if (runCommand(client_fd, name, args)) return;
+        // There is such a command, it just needs a username first
+        if (findCommand(name)) sendError(client_fd, "Error: Send your username first.");
+        else sendError(client_fd, "Error: Unknown command '" + std::string(name) + "'.");
+        return;
+    }
+    if (sender.empty()) { sendError(client_fd, "Error: Send your username first."); return; }
+
+    auto start = std::chrono::steady_clock::now();
+    switch (message.type) {
+    case MessageType::PRIVATE:
+        privateMessage(client_fd, sender, message.target, message.content);
+        recordHandler(MSG, start);
+        break;
+    case MessageType::GROUP:
+        groupMessage(client_fd, sender, message.target, message.content);
+        recordHandler(GMSG, start);
+        break;
+    case MessageType::FILE_HEADER:
+        cmdSendFile(client_fd, sender, std::string(message.target) + " " + std::string(message.content));
+        recordHandler(SENDFILE, start);
+        break;
+    default:
+        sendError(client_fd, "Error: Unexpected message type.");
+    }
+}
+
+// Run a table command; false if there is none by that name usable right now
+bool Server::runCommand(int client_fd, std::string_view name, std::string_view args) {
+    const std::string& sender = connectionOf(client_fd).username;
+    const Command* cmd = findCommand(name);
+    if (!cmd || (!cmd->before_login && sender.empty())) return false;
+
+    auto start = std::chrono::steady_clock::now();
+    (this->*cmd->handler)(client_fd, sender, args);
+    recordHandler(cmd - &command(0), start);
+    return true;
+}
+
+// Plain text: the first one is the username, the rest is chat to everyone
+void Server::handleText(int client_fd, std::string_view msg) {
+    auto start = std::chrono::steady_clock::now();
+    const std::string& sender = connectionOf(client_fd).username;
     if (sender.empty()) {
-        std::string new_username = msg;
+        handleLogin(client_fd, std::string(msg));
+        recordHandler(HANDLER_LOGIN, start);
+        return;
+    }
+
+    // Broadcast normal message
+    std::cout << sender << ": " << msg << std::endl;
+    std::string line = sender + ": ";
+    line += msg;
+    SharedBuffer payload = makeBuffer(std::move(line));
+    broadcastMessage(payload, client_fd);
+    history.append(HistoryStore::GLOBAL, payload);
+    recordChat("", *payload);
+    recordHandler(HANDLER_CHAT, start);
+}
+
+void Server::recordHandler(size_t handler, std::chrono::steady_clock::time_point start) {
+    stats.handled[handler].add();
+    stats.handler_latency[handler].record(elapsedNs(start));
+}
+
+void Server::handleLogin(int client_fd, const std::string& new_username) {
+    Connection& conn = connectionOf(client_fd);
+    conn.username = new_username;
+    auto previous = registry.login(new_username, {shard_index, client_fd}, conn.user_id);
 
-        // Force logout if username already logged in
-        if (username_fd_map.count(new_username)) {
-            int old_fd = username_fd_map[new_username];
-            sendMessage(old_fd, "You have been logged out: same username logged in elsewhere.");
-            logMessage("Client " + std::to_string(old_fd) + " forcefully logged out for username: " + new_username);
-            removeClient(old_fd);
+    // Force logout if username already logged in
+    if (previous) {
+        const std::string kick_msg = "You have been logged out: same username logged in elsewhere.";
+        logMessage("Client " + std::to_string(previous->fd) + " forcefully logged out for username: " + new_username);
+        if (previous->shard == shard_index) {
+            sendMessage(previous->fd, kick_msg);
+            removeClient(previous->fd);
+        } else {
+            registry.shard(previous->shard)->post({Envelope::Kind::KICK, previous->fd, conn.user_id, makeBuffer(kick_msg)});
         }
+    }
 
-        clients[client_fd] = new_username;
-        username_fd_map[new_username] = client_fd;
+    if (consoleAllowed()) std::cout << "Client " << client_fd << " set username to " << new_username << std::endl;
+    logMessage("Client " + std::to_string(client_fd) + " set username to " + new_username);
+    sendMessage(client_fd, "Welcome, " + new_username + "!", MessageType::ACK);
+    if (ChatConfig::HISTORY_REPLAY_ON_LOGIN) replayHistory(client_fd, conn.user_id);
+}
 
-        auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-        user_status_map[new_username] = "online since " + std::string(std::ctime(&now));
-        user_status_map[new_username].pop_back(); // remove newline
+// Switch framing; allowed before login, takes effect from the next frame
+void Server::cmdFraming(int client_fd, const std::string&, std::string_view args) {
+    Connection& conn = connectionOf(client_fd);
+    if (conn.ws) { sendError(client_fd, "Error: WebSocket connections keep WebSocket framing."); return; }
+    if (conn.session) { sendError(client_fd, "Error: Gateway sessions keep the gateway's framing."); return; }
+    if (args == "line") conn.framing = Framing::LINE;
+    else if (args == "length") conn.framing = Framing::LENGTH;
+    else if (args == "message") conn.framing = Framing::MESSAGE;
+    else { sendError(client_fd, "Error: Usage: /framing <line|length|message>"); return; }
+    sendMessage(client_fd, "Framing set to " + std::string(args) + ".", MessageType::ACK);
+}
 
-        std::cout << "Client " << client_fd << " set username to " << new_username << std::endl;
-        logMessage("Client " + std::to_string(client_fd) + " set username to " + new_username);
-        sendMessage(client_fd, "Welcome, " + new_username + "!");
+// Turn this connection into a gateway carrying many users' sessions
+// (gateway.hpp). Allowed before login, for holders of gateway_token only.
+void Server::cmdGateway(int client_fd, const std::string& sender, std::string_view args) {
+    Connection& conn = connectionOf(client_fd);
+    if (ChatConfig::GATEWAY_TOKEN.empty() || args != ChatConfig::GATEWAY_TOKEN) {
+        sendError(client_fd, "Error: Gateway access denied.");
+        return;
+    }
+    if (!sender.empty() || conn.ws || conn.session) {
+        sendError(client_fd, "Error: Only a TCP connection that hasn't logged in can become a gateway.");
         return;
     }
 
-    // Commands
-    if (msg == "/help") {
-        sendMessage(client_fd,
-            "Available commands:\n"
-            "/msg <user> <message>\n"
-            "/list\n"
-            "/whoami\n"
-            "/creategroup <group_name>\n"
-            "/addmember <group_name> <username>\n"
-            "/kickmember <group_name> <username>\n"
-            "/listgroups\n"
-            "/gmsg <group_name> <message>\n"
-            "/sendfile <user> <filename> <filesize>\n"
-            "/quit");
+    sendMessage(client_fd, "Gateway mode enabled.", MessageType::ACK);
+    conn.framing = Framing::GATEWAY;
+    conn.gateway = std::make_unique<Gateway>();
+    // Fan-out reaches its sessions, not the gateway itself
+    unlistLive(conn);
+    // Quiet users shouldn't take everyone on the gateway with them
+    if (conn.idle_timer != NO_TIMER) timers.cancel(conn.idle_timer);
+    conn.idle_timer = NO_TIMER;
+    logMessage("Client " + std::to_string(client_fd) + " became a gateway");
+}
+
+void Server::cmdHelp(int client_fd, const std::string&, std::string_view) {
+    sendMessage(client_fd,
+        "Available commands:\n"
+        "/msg <user> <message>\n"
+        "/list\n"
+        "/whoami\n"
+        "/creategroup <group_name>\n"
+        "/addmember <group_name> <username>\n"
+        "/kickmember <group_name> <username>\n"
+        "/listgroups\n"
+        "/gmsg <group_name> <message>\n"
+        "/sendfile <user> <filename> <filesize>\n"
+        "/framing <line|length|message>\n"
+        "/history [group_name] [count]\n"
+        "/stats\n"
+        "/quit");
+}
+
+// Metrics snapshot for the usernames listed in admin_users
+void Server::cmdStats(int client_fd, const std::string& sender, std::string_view) {
+    const auto& admins = ChatConfig::ADMIN_USERS;
+    if (std::find(admins.begin(), admins.end(), sender) == admins.end()) {
+        sendError(client_fd, "Error: Only server admins can view stats.");
         return;
     }
+    sendMessage(client_fd, metrics.render());
+}
+
+void Server::cmdWhoami(int client_fd, const std::string& sender, std::string_view) {
+    sendMessage(client_fd, "You are logged in as: " + sender);
+}
+
+void Server::cmdList(int client_fd, const std::string&, std::string_view) {
+    sendBuffer(client_fd, registry.onlineList());
+}
+
+// Private message
+void Server::cmdPrivateMessage(int client_fd, const std::string& sender, std::string_view args) {
+    auto [target_view, msg_view] = splitToken(args);
+    if (target_view.empty() || msg_view.empty()) { sendError(client_fd, "Error: Usage: /msg <user> <message>"); return; }
+    privateMessage(client_fd, sender, target_view, msg_view);
+}
+
+void Server::privateMessage(int client_fd, const std::string& sender, std::string_view target_view, std::string_view msg_view) {
+    std::string target(target_view), private_msg(msg_view);
+    if (target == sender) { sendError(client_fd, "Error: Cannot message yourself."); return; }
+
+    auto route = registry.find(target);
+    if (!route) { sendError(client_fd, "Error: User '" + target + "' not found."); return; }
+
+    deliver(*route, "[Private] " + sender + ": " + private_msg, MessageType::PRIVATE);
+    sendMessage(client_fd, "[Private to " + target + "] " + private_msg, MessageType::ACK);
+    logMessage("[Private] " + sender + " -> " + target + ": " + private_msg);
+}
+
+// Group creation
+void Server::cmdCreateGroup(int client_fd, const std::string&, std::string_view args) {
+    std::string group_name(args);
+    if (group_name.empty()) { sendError(client_fd, "Error: Usage: /creategroup <group_name>"); return; }
+    if (registry.createGroup(group_name, connectionOf(client_fd).user_id) == GroupStatus::EXISTS) { sendError(client_fd, "Error: Group already exists."); return; }
+    // Groups don't outlive the process but stored history does; a reused name starts empty
+    if (store) store->resetChannel(group_name);
+    sendMessage(client_fd, "Group '" + group_name + "' created. You are admin.", MessageType::ACK);
+}
+
+// Add member
+void Server::cmdAddMember(int client_fd, const std::string&, std::string_view args) {
+    auto [group_view, user_view] = splitToken(args);
+    if (user_view.empty()) { sendError(client_fd, "Error: Usage: /addmember <group_name> <username>"); return; }
+    std::string group_name(group_view), new_user(user_view);
+    GroupStatus status = registry.addMember(group_name, connectionOf(client_fd).user_id, new_user);
+    if (status == GroupStatus::NO_GROUP) { sendError(client_fd, "Error: Group does not exist."); return; }
+    if (status == GroupStatus::NOT_ADMIN) { sendError(client_fd, "Error: Only admins can add members."); return; }
+    sendMessage(client_fd, "User '" + new_user + "' added to group '" + group_name + "'.", MessageType::ACK);
+}
+
+// Kick member
+void Server::cmdKickMember(int client_fd, const std::string&, std::string_view args) {
+    auto [group_view, user_view] = splitToken(args);
+    if (user_view.empty()) { sendError(client_fd, "Error: Usage: /kickmember <group_name> <username>"); return; }
+    std::string group_name(group_view), target_user(user_view);
+    GroupStatus status = registry.kickMember(group_name, connectionOf(client_fd).user_id, target_user);
+    if (status == GroupStatus::NO_GROUP) { sendError(client_fd, "Error: Group does not exist."); return; }
+    if (status == GroupStatus::NOT_ADMIN) { sendError(client_fd, "Error: Only admins can kick members."); return; }
+    if (status == GroupStatus::NOT_MEMBER) { sendError(client_fd, "Error: User is not in the group."); return; }
+    sendMessage(client_fd, "User '" + target_user + "' removed from group '" + group_name + "'.", MessageType::ACK);
+}
+
+// List groups
+void Server::cmdListGroups(int client_fd, const std::string&, std::string_view) {
+    sendMessage(client_fd, registry.renderGroupsOf(connectionOf(client_fd).user_id));
+}
+
+// Group message
+void Server::cmdGroupMessage(int client_fd, const std::string& sender, std::string_view args) {
+    auto [group_view, msg_view] = splitToken(args);
+    if (msg_view.empty()) { sendError(client_fd, "Error: Usage: /gmsg <group_name> <message>"); return; }
+    groupMessage(client_fd, sender, group_view, msg_view);
+}
+
+void Server::groupMessage(int client_fd, const std::string& sender, std::string_view group_view, std::string_view msg_view) {
+    std::string group_name(group_view), group_msg(msg_view);
+
+    RouteList recipients;
+    GroupId group_id;
+    GroupStatus status = registry.groupRecipients(group_name, connectionOf(client_fd).user_id, recipients, group_id);
+    if (status == GroupStatus::NO_GROUP) { sendError(client_fd, "Error: Group '" + group_name + "' does not exist."); return; }
+    if (status == GroupStatus::NOT_MEMBER) { sendError(client_fd, "Error: You are not a member of group '" + group_name + "'."); return; }
+
+    // Built once, shared by every member's queue (the sender included)
+    SharedBuffer line = makeBuffer("[Group " + group_name + "] " + sender + ": " + group_msg);
+    for (const Route& route : *recipients) {
+        if (route.loc.shard != shard_index || route.loc.fd != client_fd) deliverBuffer(route, line, MessageType::GROUP);
+    }
+    sendBuffer(client_fd, line, MessageType::GROUP);
+    history.append(HistoryStore::channelOf(group_id), line);
+    recordChat(group_name, *line);
+}
 
-    if (msg == "/whoami") {
-        sendMessage(client_fd, "You are logged in as: " + sender);
+// Recent lines: "/history [count]" for the main room, "/history <group> [count]" for a group
+void Server::cmdHistory(int client_fd, const std::string&, std::string_view args) {
+    auto [group_view, count_view] = splitToken(args);
+    if (count_view.empty() && !group_view.empty() &&
+        std::all_of(group_view.begin(), group_view.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        count_view = group_view;
+        group_view = {};
+    }
+
+    size_t count = history.perChannel() ? history.perChannel() : DEFAULT_HISTORY_LINES;
+    if (!count_view.empty()) {
+        auto [end, ec] = std::from_chars(count_view.data(), count_view.data() + count_view.size(), count);
+        if (ec != std::errc() || end != count_view.data() + count_view.size() || count == 0) {
+            sendError(client_fd, "Error: Usage: /history [group_name] [count]");
+            return;
+        }
+    }
+
+    batch_scratch.clear();
+    if (group_view.empty()) {
+        batchHistory(HistoryStore::GLOBAL, "", count, "History of the main room:", MessageType::TEXT);
+    } else {
+        std::string group_name(group_view);
+        GroupId group_id;
+        GroupStatus status = registry.memberGroup(group_name, connectionOf(client_fd).user_id, group_id);
+        if (status == GroupStatus::NO_GROUP) { sendError(client_fd, "Error: Group '" + group_name + "' does not exist."); return; }
+        if (status == GroupStatus::NOT_MEMBER) { sendError(client_fd, "Error: You are not a member of group '" + group_name + "'."); return; }
+        batchHistory(HistoryStore::channelOf(group_id), group_name, count, "History of group '" + group_name + "':", MessageType::GROUP);
+    }
+
+    if (batch_scratch.empty()) sendMessage(client_fd, "No messages in history.");
+    else sendBatch(client_fd, batch_scratch);
+}
+
+// Append a channel's recent lines to batch_scratch under a title; nothing if it has none.
+// The ring answers when it holds enough lines, the store (which trails live
+// chat by one write batch) when it does not, e.g. for long counts or after a restart.
+void Server::batchHistory(uint32_t channel, std::string_view stored_channel, size_t count,
+                          const std::string& title, MessageType type) {
+    history_scratch.clear();
+    history.recent(channel, count, history_scratch);
+    if (history_scratch.size() < count && store) {
+        history_scratch.clear();
+        store->recent(stored_channel, std::min(count, MAX_HISTORY_LINES), history_scratch);
+    }
+    if (history_scratch.empty()) return;
+    batch_scratch.push_back({makeBuffer(title), MessageType::TEXT});
+    for (const SharedBuffer& line : history_scratch) batch_scratch.push_back({line, type});
+}
+
+// The main room and each of the user's groups, as one reply
+void Server::replayHistory(int client_fd, UserId user) {
+    size_t count = history.perChannel() ? history.perChannel() : DEFAULT_HISTORY_LINES;
+    batch_scratch.clear();
+    batchHistory(HistoryStore::GLOBAL, "", count, "History of the main room:", MessageType::TEXT);
+    for (const auto& [id, name] : registry.groupsOf(user))
+        batchHistory(HistoryStore::channelOf(id), name, count, "History of group '" + name + "':", MessageType::GROUP);
+    if (!batch_scratch.empty()) sendBatch(client_fd, batch_scratch);
+}
+
+// File transfer
+void Server::cmdSendFile(int client_fd, const std::string& sender, std::string_view args) {
+    std::istringstream iss{std::string(args)};
+    std::string target, filepath_or_filename;
+    std::string remaining_params;
+    
+    // Uploads are raw bytes on the sender's socket, which a session doesn't have
+    if (connectionOf(client_fd).session) {
+        sendError(client_fd, "Error: File transfer is not available through a gateway.");
         return;
     }
 
-    if (msg == "/list") {
-        std::string list_text = "Online users:\n";
-        for (auto& [username, status] : user_status_map)
-            list_text += username + " (" + status + ")\n";
-        sendMessage(client_fd, list_text);
+    // Parse: <target> <filepath_or_filename> [optional_size]
+    if (!(iss >> target >> filepath_or_filename)) {
+        sendError(client_fd, "Error: Usage: /sendfile <user> <filepath_or_filename> [filesize]");
+        return;
+    }
+    
+    // Check if third parameter exists (filesize)
+    std::string size_param;
+    iss >> size_param;
+    
+    auto route = registry.find(target);
+    if (!route) {
+        sendError(client_fd, "Error: User '" + target + "' not found.");
+        return;
+    }
+    if (route->loc.fd >= SESSION_BASE) {
+        sendError(client_fd, "Error: User '" + target + "' is connected through a gateway and can't receive files.");
         return;
     }
+    
+    // No size: the argument is a path on the server, streamed with sendfile()
+    if (size_param.empty()) {
+        std::string filename = filepath_or_filename.substr(filepath_or_filename.find_last_of("/\\") + 1);
 
-    // Private message
-    if (msg.rfind("/msg ", 0) == 0) {
-        size_t space_pos = msg.find(' ', 5);
-        if (space_pos == std::string::npos) { sendMessage(client_fd, "Error: Usage: /msg <user> <message>"); return; }
-        std::string target = trim(msg.substr(5, space_pos - 5));
-        std::string private_msg = trim(msg.substr(space_pos + 1));
-        if (target.empty() || private_msg.empty()) { sendMessage(client_fd, "Error: Usage: /msg <user> <message>"); return; }
-        if (target == sender) { sendMessage(client_fd, "Error: Cannot message yourself."); return; }
+        int file_fd = open(filepath_or_filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file_fd == -1) {
+            if (errno == ENOENT) sendError(client_fd, "Error: File '" + filepath_or_filename + "' not found.");
+            else sendError(client_fd, "Error: Cannot access file '" + filepath_or_filename + "': " + std::strerror(errno));
+            return;
+        }
+        SharedFile file = std::make_shared<const FileSource>(file_fd);
+
+        struct stat st;
+        if (fstat(file_fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+            sendError(client_fd, "Error: Cannot access file '" + filepath_or_filename + "': not a regular file.");
+            return;
+        }
+        uint64_t filesize = st.st_size;
+        std::cout << "File found: " << filepath_or_filename << " (" << filesize << " bytes)" << std::endl;
 
-        auto it = username_fd_map.find(target);
-        if (it == username_fd_map.end()) { sendMessage(client_fd, "Error: User '" + target + "' not found."); return; }
-        int target_fd = it->second;
+        // Queued in order on the receiver; the file bytes never enter user space
+        // and go out across EPOLLOUT wakeups without stalling this loop
+        deliver(*route, "[File incoming] " + filename + " from " + sender +
+                            " (" + std::to_string(filesize) + " bytes)", MessageType::FILE_HEADER);
+        deliverFile(*route, file, filesize);
+        deliver(*route, "File '" + filename + "' received successfully from " + sender, MessageType::ACK);
 
-        sendMessage(target_fd, "[Private] " + sender + ": " + private_msg);
-        sendMessage(client_fd, "[Private to " + target + "] " + private_msg);
-        logMessage("[Private] " + sender + " -> " + target + ": " + private_msg);
+        // The receiver's confirmation goes out behind the bytes; the sender
+        // only learns they are on their way
+        sendMessage(client_fd, "File '" + filename + "' queued for delivery to " + target, MessageType::ACK);
+        logMessage("File transfer: " + sender + " -> " + target + " (" + filename + ", " + std::to_string(filesize) + " bytes)");
         return;
     }
 
-    // Group creation
-    if (msg.rfind("/creategroup ", 0) == 0) {
-        std::string group_name = trim(msg.substr(13));
-        if (group_name.empty()) { sendMessage(client_fd, "Error: Usage: /creategroup <group_name>"); return; }
-        if (groups.count(group_name)) { sendMessage(client_fd, "Error: Group already exists."); return; }
-        groups[group_name].insert(sender);
-        group_admins[group_name].insert(sender);
-        sendMessage(client_fd, "Group '" + group_name + "' created. You are admin.");
+    // Size provided - traditional mode (filename + size, client sends data)
+    std::string filename = filepath_or_filename;
+    int filesize = 0;
+    try {
+        filesize = std::stoi(size_param);
+    } catch (const std::exception& e) {
+        sendError(client_fd, "Error: Invalid file size '" + size_param + "'");
         return;
     }
+    if (filesize < 0) { sendError(client_fd, "Error: Invalid file size '" + size_param + "'"); return; }
+
+    // Notify receiver
+    deliver(*route, "[File incoming] " + filename + " from " + sender +
+                        " (" + std::to_string(filesize) + " bytes)", MessageType::FILE_HEADER);
+
+    // Use bytes already buffered behind the header first
+    uint64_t remaining = filesize;
+    ByteBuffer& leftover = connectionOf(client_fd).inbound;
+    if (!leftover.empty()) {
+        size_t chunk = std::min<uint64_t>(leftover.size(), remaining);
+        deliver(*route, std::string(leftover.data(), chunk), MessageType::FILE_CHUNK);
+        leftover.consume(chunk);
+        remaining -= chunk;
+    }
 
-    // Add member
-    if (msg.rfind("/addmember ", 0) == 0) {
-        size_t space_pos = msg.find(' ', 11);
-        if (space_pos == std::string::npos) { sendMessage(client_fd, "Error: Usage: /addmember <group_name> <username>"); return; }
-        std::string group_name = trim(msg.substr(11, space_pos - 11));
-        std::string new_user = trim(msg.substr(space_pos + 1));
-        if (!groups.count(group_name)) { sendMessage(client_fd, "Error: Group does not exist."); return; }
-        if (!group_admins[group_name].count(sender)) { sendMessage(client_fd, "Error: Only admins can add members."); return; }
-        groups[group_name].insert(new_user);
-        sendMessage(client_fd, "User '" + new_user + "' added to group '" + group_name + "'.");
+    if (remaining == 0) {
+        sendMessage(client_fd, "File '" + filename + "' queued for delivery to " + target, MessageType::ACK);
+        deliver(*route, "File '" + filename + "' received successfully from " + sender, MessageType::ACK);
         return;
     }
 
-    // Kick member
-    if (msg.rfind("/kickmember ", 0) == 0) {
-        size_t space_pos = msg.find(' ', 12);
-        if (space_pos == std::string::npos) { sendMessage(client_fd, "Error: Usage: /kickmember <group_name> <username>"); return; }
-        std::string group_name = trim(msg.substr(12, space_pos - 12));
-        std::string target_user = trim(msg.substr(space_pos + 1));
-        if (!groups.count(group_name)) { sendMessage(client_fd, "Error: Group does not exist."); return; }
-        if (!group_admins[group_name].count(sender)) { sendMessage(client_fd, "Error: Only admins can kick members."); return; }
-        if (!groups[group_name].count(target_user)) { sendMessage(client_fd, "Error: User is not in the group."); return; }
-        groups[group_name].erase(target_user);
-        group_admins[group_name].erase(target_user);
-        sendMessage(client_fd, "User '" + target_user + "' removed from group '" + group_name + "'.");
+    // Relay the rest through a pipe: the event loop splices the sender's socket
+    // into it and the receiver's queue splices it out, each at its own pace
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_NONBLOCK | O_CLOEXEC) == -1) {
+        connectionOf(client_fd).skip_bytes = remaining;
+        sendError(client_fd, "Error: File transfer interrupted.");
+        deliver(*route, "Error: File transfer from " + sender + " failed.", MessageType::ERROR);
         return;
     }
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, RELAY_PIPE_SIZE); // best effort; the default is 64 KiB
 
-    // List groups
-    if (msg == "/listgroups") {
-        std::string response = "Groups you are in:\n";
-        for (auto& [grp, members] : groups) {
-            if (members.count(sender)) {
-                response += grp + " (Admins: ";
-                for (auto& admin : group_admins[grp]) response += admin + " ";
-                response += ")\nMembers: ";
-                for (auto& mem : members) response += mem + " ";
-                response += "\n";
-            }
+    deliverFile(*route, std::make_shared<const FileSource>(pipe_fds[0], true), remaining);
+    Connection& conn = connectionOf(client_fd);
+    conn.upload = std::make_unique<Upload>(
+        Upload{std::make_shared<const FileSource>(pipe_fds[1], true), remaining, *route, target, filename});
+    conn.upload_mark = remaining;
+    armTimer(conn.upload_timer, client_fd, TimerKind::UPLOAD, ChatConfig::FILE_TRANSFER_TIMEOUT);
+}
+
+void Server::removeClient(int client_fd) {
+    Connection* conn = findConnection(client_fd);
+    if (!conn) return;
+
+    std::string name = conn->username;
+    if (conn->upload) {
+        // The receiver gets whatever already reached the pipe, then this
+        deliver(conn->upload->target, "Error: File transfer from " + name + " failed.", MessageType::ERROR);
+    }
+    if (conn->user_id != NO_USER) {
+        // mark offline
+        registry.logout(conn->user_id, {shard_index, client_fd});
+
+        if (consoleAllowed()) std::cout << "Client disconnected: " << name << std::endl;
+        logMessage("Client disconnected: " + name);
+    }
+
+    for (TimerId timer : {conn->idle_timer, conn->stall_timer, conn->upload_timer})
+        if (timer != NO_TIMER) timers.cancel(timer);
+
+    if (conn->session) {
+        // Tell the gateway, unless it asked for this itself or is going away
+        const Session& session = *conn->session;
+        Connection* gateway = findConnection(session.gateway_fd);
+        if (gateway && gateway->gateway && gateway->gateway->sessions.erase(session.id)) {
+            std::string frame(GatewayFrame::HEADER_SIZE, '\0');
+            GatewayFrame::encodeHeader(frame.data(), 0, session.id, GatewayFrame::CLOSE);
+            sendRaw(session.gateway_fd, makeBuffer(std::move(frame)));
+        }
+        free_sessions.push_back(client_fd - SESSION_BASE);
+    } else {
+        if (conn->gateway) {
+            // Its sessions end with it
+            std::unordered_map<uint32_t, int> carried;
+            carried.swap(conn->gateway->sessions);
+            for (const auto& entry : carried) removeClient(entry.second);
         }
-        sendMessage(client_fd, response);
+        io->remove(client_fd);
+        close(client_fd);
+        stats.connected.add(-1);
+        stats.outbound_bytes.add(-(int64_t)conn->outbound.size());
+        // The kernel may still be reading an in-flight send's buffers
+        if (conn->send_tag) orphaned_sends.emplace(conn->send_tag, std::move(conn->outbound));
+    }
+
+    // Leave the packed fd list (gateways already have), then recycle the slot
+    if (!conn->gateway) unlistLive(*conn);
+    *conn = Connection{};
+}
+
+// Swap-remove from live_fds
+void Server::unlistLive(Connection& conn) {
+    int moved = live_fds.back();
+    live_fds[conn.live_index] = moved;
+    connectionOf(moved).live_index = conn.live_index;
+    live_fds.pop_back();
+}
+
+Connection* Server::findConnection(int client_fd) {
+    if (client_fd >= SESSION_BASE) {
+        size_t index = client_fd - SESSION_BASE;
+        if (index >= sessions.size() || !sessions[index].open) return nullptr;
+        return &sessions[index];
+    }
+    if (client_fd < 0 || (size_t)client_fd >= connections.size() || !connections[client_fd].open) return nullptr;
+    return &connections[client_fd];
+}
+
+Connection& Server::connectionOf(int client_fd) {
+    return client_fd >= SESSION_BASE ? sessions[client_fd - SESSION_BASE] : connections[client_fd];
+}
+
+// One buffer for every recipient on every shard
+void Server::broadcastMessage(const SharedBuffer& payload, int exclude_fd) {
+    // live_fds is packed, so fan-out touches only open sockets
+    for (size_t i = 0; i < live_fds.size(); ++i) {
+        if (live_fds[i] != exclude_fd) sendBuffer(live_fds[i], payload);
+    }
+
+    for (size_t i = 0; i < registry.shardCount(); ++i) {
+        if ((int)i != shard_index) registry.shard(i)->post({Envelope::Kind::BROADCAST, -1, NO_USER, payload});
+    }
+}
+
+void Server::deliver(const Route& route, std::string msg, MessageType type) {
+    deliverBuffer(route, makeBuffer(std::move(msg)), type);
+}
+
+void Server::deliverBuffer(const Route& route, const SharedBuffer& payload, MessageType type) {
+    if (route.loc.shard == shard_index) sendBuffer(route.loc.fd, payload, type);
+    else registry.shard(route.loc.shard)->post({Envelope::Kind::DELIVER, route.loc.fd, route.user, payload, nullptr, 0, type});
+}
+
+void Server::deliverFile(const Route& route, const SharedFile& file, uint64_t size) {
+    if (route.loc.shard == shard_index) sendFile(route.loc.fd, file, size);
+    else registry.shard(route.loc.shard)->post({Envelope::Kind::STREAM, route.loc.fd, route.user, nullptr, file, size});
+}
+
+void Server::stop() {
+    stopping.store(true, std::memory_order_relaxed);
+    uint64_t one = 1;
+    write(wake_fd, &one, sizeof(one));
+}
+
+void Server::post(Envelope env) {
+    {
+        std::lock_guard<std::mutex> lock(mailbox_mutex);
+        mailbox.push_back(std::move(env));
+        stats.mailbox_depth.set(mailbox.size());
+    }
+    uint64_t one = 1;
+    write(wake_fd, &one, sizeof(one));
+}
+
+void Server::drainMailbox() {
+    uint64_t count;
+    read(wake_fd, &count, sizeof(count));
+
+    std::vector<Envelope> batch;
+    {
+        std::lock_guard<std::mutex> lock(mailbox_mutex);
+        batch.swap(mailbox);
+        stats.mailbox_depth.set(0);
+    }
+
+    for (auto& env : batch) {
+        if (env.kind == Envelope::Kind::BROADCAST) {
+            for (size_t i = 0; i < live_fds.size(); ++i) sendBuffer(live_fds[i], env.payload);
+            continue;
+        }
+
+        // The fd may have been closed (and reused) since the envelope was posted
+        Connection* conn = findConnection(env.fd);
+        if (!conn || conn->user_id != env.user) continue;
+
+        if (env.kind == Envelope::Kind::STREAM) sendFile(env.fd, env.file, env.file_size);
+        else if (env.payload) sendBuffer(env.fd, env.payload, env.type);
+        if (env.kind == Envelope::Kind::KICK) removeClient(env.fd);
+    }
+}
+
+void Server::sendMessage(int client_fd, std::string msg, MessageType type) {
+    sendBuffer(client_fd, makeBuffer(std::move(msg)), type);
+}
+
+void Server::sendError(int client_fd, std::string msg) {
+    sendBuffer(client_fd, makeBuffer(std::move(msg)), MessageType::ERROR);
+}
+
+// A length prefix is 32 bits, so big files go out as several frames
+static constexpr uint64_t MAX_FILE_FRAME = 1u << 30;
+
+static_assert(Message::HEADER_SIZE <= FrameHeader::MAX_SIZE &&
+              WebSocketFrame::MAX_SERVER_HEADER <= FrameHeader::MAX_SIZE &&
+              GatewayFrame::HEADER_SIZE <= FrameHeader::MAX_SIZE, "frame headers must fit a queue segment");
+
+// Frame header for `length` payload bytes (`type` for MESSAGE and WEBSOCKET,
+// `session` for GATEWAY); LINE replies go out unframed
+static FrameHeader frameHeader(Framing framing, MessageType type, uint64_t length, uint32_t session = 0) {
+    FrameHeader header;
+    char* out = header.bytes.data();
+    if (framing == Framing::LENGTH) {
+        uint32_t prefix = htonl(length);
+        std::memcpy(out, &prefix, sizeof(prefix));
+        header.size = sizeof(prefix);
+    } else if (framing == Framing::MESSAGE) {
+        Message::encodeHeader(out, type, 0, 0, length);
+        header.size = Message::HEADER_SIZE;
+    } else if (framing == Framing::WEBSOCKET) {
+        // Replies are text messages; file bytes go out as binary ones
+        uint8_t opcode = type == MessageType::FILE_CHUNK ? WebSocketFrame::BINARY : WebSocketFrame::TEXT;
+        header.size = WebSocketFrame::encodeHeader(out, opcode, length);
+    } else if (framing == Framing::GATEWAY) {
+        GatewayFrame::encodeHeader(out, length, session, GatewayFrame::DATA, (uint8_t)type);
+        header.size = GatewayFrame::HEADER_SIZE;
+    }
+    return header;
+}
+
+void Server::sendBuffer(int client_fd, const SharedBuffer& payload, MessageType type) {
+    Connection* slot = findConnection(client_fd);
+    if (!slot) return;
+    Connection& conn = *slot;
+    if (conn.session) { sendToSession(client_fd, conn, payload, type); return; }
+
+    // Slow reader: cut it off rather than buffer without bound
+    if (conn.outbound.size() + payload->size() > (size_t)ChatConfig::MAX_OUTBOUND_QUEUE) {
+        shutdown(client_fd, SHUT_RDWR);
         return;
     }
 
-    // Group message
-    if (msg.rfind("/gmsg ", 0) == 0) {
-        size_t space_pos = msg.find(' ', 6);
-        if (space_pos == std::string::npos) { sendMessage(client_fd, "Error: Usage: /gmsg <group_name> <message>"); return; }
-        std::string group_name = trim(msg.substr(6, space_pos - 6));
-        std::string group_msg = trim(msg.substr(space_pos + 1));
-        if (!groups.count(group_name)) { sendMessage(client_fd, "Error: Group '" + group_name + "' does not exist."); return; }
-        if (!groups[group_name].count(sender)) { sendMessage(client_fd, "Error: You are not a member of group '" + group_name + "'."); return; }
+    size_t queued = conn.outbound.size();
+    conn.outbound.push(payload, frameHeader(conn.framing, type, payload->size()));
+    stats.outbound_bytes.add(conn.outbound.size() - queued);
 
-        for (const auto& member : groups[group_name]) {
-            if (username_fd_map.count(member)) {
-                int member_fd = username_fd_map[member];
-                if (member_fd != client_fd) sendMessage(member_fd, "[Group " + group_name + "] " + sender + ": " + group_msg);
-            }
+    // Write straight through while EPOLLOUT isn't pending, keep the rest for it
+    if (!conn.write_armed) flushOutbound(client_fd);
+}
+
+// Many lines queued together and written with one flush (one sendmsg() for
+// up to 64 of them) instead of one send per line
+void Server::sendBatch(int client_fd, const std::vector<BatchLine>& lines) {
+    Connection* slot = findConnection(client_fd);
+    if (!slot) return;
+    Connection& conn = *slot;
+
+    if (conn.session) {
+        for (const BatchLine& line : lines) sendToSession(client_fd, conn, line.payload, line.type);
+        return;
+    }
+
+    // LINE output has no frame boundaries, so the lines become one '\n'-joined payload
+    if (conn.framing == Framing::LINE) {
+        std::string text;
+        for (const BatchLine& line : lines) {
+            if (!text.empty()) text += '\n';
+            text += *line.payload;
         }
-        sendMessage(client_fd, "[Group " + group_name + "] " + sender + ": " + group_msg);
-        logMessage("[Group " + group_name + "] " + sender + ": " + group_msg);
+        sendMessage(client_fd, std::move(text));
         return;
     }
 
-    // File transfer
-    // Inside Server::handleClientMessage
-    // File transfer
-    if (msg.rfind("/sendfile ", 0) == 0) {
-        std::istringstream iss(msg.substr(10));
-        std::string target, filepath_or_filename;
-        std::string remaining_params;
-        
-        // Parse: <target> <filepath_or_filename> [optional_size]
-        if (!(iss >> target >> filepath_or_filename)) {
-            sendMessage(client_fd, "Error: Usage: /sendfile <user> <filepath_or_filename> [filesize]");
-            return;
+    size_t total = 0;
+    for (const BatchLine& line : lines) total += line.payload->size();
+    if (conn.outbound.size() + total > (size_t)ChatConfig::MAX_OUTBOUND_QUEUE) {
+        shutdown(client_fd, SHUT_RDWR);
+        return;
+    }
+
+    size_t queued = conn.outbound.size();
+    for (const BatchLine& line : lines)
+        conn.outbound.push(line.payload, frameHeader(conn.framing, line.type, line.payload->size()));
+    stats.outbound_bytes.add(conn.outbound.size() - queued);
+    if (!conn.write_armed) flushOutbound(client_fd);
+}
+
+// Bytes that are already framed, or (the HTTP handshake) never are
+void Server::sendRaw(int client_fd, const SharedBuffer& bytes) {
+    Connection* slot = findConnection(client_fd);
+    if (!slot) return;
+    Connection& conn = *slot;
+
+    if (conn.outbound.size() + bytes->size() > (size_t)ChatConfig::MAX_OUTBOUND_QUEUE) {
+        shutdown(client_fd, SHUT_RDWR);
+        return;
+    }
+
+    size_t queued = conn.outbound.size();
+    conn.outbound.push(bytes);
+    stats.outbound_bytes.add(conn.outbound.size() - queued);
+    if (!conn.write_armed) flushOutbound(client_fd);
+}
+
+// A reply to a gateway session goes out on the gateway's socket while the
+// session has credit and is held back otherwise, so one slow user can't
+// fill the socket everyone on the gateway shares. A session may hold one
+// window beyond its credit; past that it is cut off, not the gateway.
+void Server::sendToSession(int session_fd, Connection& conn, const SharedBuffer& payload, MessageType type) {
+    Session& session = *conn.session;
+    if (session.kicked) return;
+    session.held.push_back({payload, type});
+    session.held_bytes += payload->size();
+    int64_t allowed = (int64_t)ChatConfig::GATEWAY_SESSION_WINDOW + std::max<int64_t>(session.credit, 0);
+    if ((int64_t)session.held_bytes > allowed) {
+        // The notice skips the credit it could never get; once kicked,
+        // sendBuffer() would drop it. Closed from the mailbox rather than
+        // here: fan-out may be walking live_fds.
+        session.kicked = true;
+        session.held.clear();
+        session.held_bytes = 0;
+        if (Connection* gateway = findConnection(session.gateway_fd)) {
+            size_t queued = gateway->outbound.size();
+            SharedBuffer notice = makeBuffer("Error: Too far behind.");
+            gateway->outbound.push(notice, frameHeader(Framing::GATEWAY, MessageType::ERROR, notice->size(), session.id));
+            stats.outbound_bytes.add(gateway->outbound.size() - queued);
         }
-        
-        // Check if third parameter exists (filesize)
-        std::string size_param;
-        iss >> size_param;
-        
-        auto it = username_fd_map.find(target);
-        if (it == username_fd_map.end()) {
-            sendMessage(client_fd, "Error: User '" + target + "' not found.");
+        post({Envelope::Kind::KICK, session_fd, conn.user_id, nullptr});
+        return;
+    }
+    releaseHeld(conn);
+}
+
+// Move held replies onto the gateway's queue as far as the session's credit
+// goes, and while that queue is within its own budget
+void Server::releaseHeld(Connection& conn) {
+    Session& session = *conn.session;
+    Connection* gateway = findConnection(session.gateway_fd);
+    if (!gateway || session.held.empty() || session.credit <= 0) return;
+
+    size_t queued = gateway->outbound.size();
+    while (!session.held.empty() && session.credit > 0 &&
+           gateway->outbound.size() < (size_t)ChatConfig::MAX_OUTBOUND_QUEUE) {
+        const BatchLine& line = session.held.front();
+        gateway->outbound.push(line.payload, frameHeader(Framing::GATEWAY, line.type, line.payload->size(), session.id));
+        session.credit -= line.payload->size();
+        session.held_bytes -= line.payload->size();
+        session.held.pop_front();
+    }
+    stats.outbound_bytes.add(gateway->outbound.size() - queued);
+    if (!gateway->write_armed) flushOutbound(session.gateway_fd);
+}
+
+// WebSocket control frame (pong, close); payloads are at most 125 bytes
+void Server::sendControl(int client_fd, uint8_t opcode, std::string_view payload) {
+    std::string frame(WebSocketFrame::MAX_SERVER_HEADER, '\0');
+    frame.resize(WebSocketFrame::encodeHeader(frame.data(), opcode, payload.size()));
+    frame += payload;
+    sendRaw(client_fd, makeBuffer(std::move(frame)));
+}
+
+// File bytes are queued behind whatever is already pending and sent with sendfile()
+void Server::sendFile(int client_fd, const SharedFile& file, uint64_t size) {
+    Connection* slot = findConnection(client_fd);
+    if (!slot || slot->session) return;  // cmdSendFile refuses gateway sessions
+    Connection& conn = *slot;
+
+    bool framed = conn.framing != Framing::LINE;
+    if (size == 0 && !framed) return;
+
+    size_t queued = conn.outbound.size();
+    uint64_t offset = 0;
+    do {
+        uint64_t frame = framed ? std::min(size - offset, MAX_FILE_FRAME) : size;
+        conn.outbound.pushFile(file, offset, frame, frameHeader(conn.framing, MessageType::FILE_CHUNK, frame));
+        offset += frame;
+    } while (offset < size);
+    stats.outbound_bytes.add(conn.outbound.size() - queued);
+    if (!conn.write_armed) flushOutbound(client_fd);
+}
+
+void Server::flushOutbound(int client_fd) {
+    Connection* slot = findConnection(client_fd);
+    if (!slot) return;
+    Connection& conn = *slot;
+    if (conn.send_tag) return;  // its completion continues from there
+
+    // io_uring: in-memory bytes go out as one sendmsg() submitted with the
+    // next wait, batched with every other send of this pass
+    if (io->sendsAsync()) {
+        iovec iov[OutboundQueue::MAX_IOV];
+        size_t count = conn.outbound.gather(iov, OutboundQueue::MAX_IOV);
+        if (count > 0) {
+            setWriteInterest(client_fd, false);
+            conn.send_tag = ++last_send_tag;
+            io->send(client_fd, conn.send_tag, iov, count);
+            if (conn.stall_timer == NO_TIMER) {
+                conn.stall_mark = conn.outbound.sentTotal();
+                armTimer(conn.stall_timer, client_fd, TimerKind::WRITE_STALL, ChatConfig::WRITE_STALL_TIMEOUT);
+            }
             return;
         }
-        
-        int target_fd = it->second;
-        std::string filename;
-        int filesize = 0;
-        bool is_filepath = false;
-        
-        // Determine if it's a file path or just filename with size
-        if (size_param.empty()) {
-            // No size provided - assume it's a file path, try to read it
-            is_filepath = true;
-            filename = filepath_or_filename.substr(filepath_or_filename.find_last_of("/\\") + 1);
-            
-            try {
-                // Check if file exists and get size
-                if (std::filesystem::exists(filepath_or_filename)) {
-                    filesize = std::filesystem::file_size(filepath_or_filename);
-                    std::cout << "File found: " << filepath_or_filename << " (" << filesize << " bytes)" << std::endl;
-                } else {
-                    sendMessage(client_fd, "Error: File '" + filepath_or_filename + "' not found.");
-                    return;
-                }
-            } catch (const std::exception& e) {
-                sendMessage(client_fd, "Error: Cannot access file '" + filepath_or_filename + "': " + e.what());
-                return;
+        // Nothing in memory at the front: file ranges still go through flush()
+    }
+
+    size_t queued = conn.outbound.size();
+    uint64_t sent = conn.outbound.sentTotal();
+    FlushResult result = conn.outbound.flush(client_fd);
+    if (result == FlushResult::FAILED) {
+        // Peer is gone or a file came up short; either way the stream is broken
+        conn.outbound.clear();
+        shutdown(client_fd, SHUT_RDWR);
+    } else if (result == FlushResult::STARVED) {
+        // Nothing to write until the sender fills the relay pipe
+        watchPipe(conn.outbound.stalledOn().fd, EPOLLIN, client_fd);
+    }
+    stats.bytes_out.add(conn.outbound.sentTotal() - sent);
+    stats.outbound_bytes.add((int64_t)conn.outbound.size() - (int64_t)queued);
+    // Yielded with the socket still writable: re-arm so edge-triggered mode reports it again
+    setWriteInterest(client_fd, !conn.outbound.empty() && result != FlushResult::STARVED,
+                     result == FlushResult::YIELDED);
+}
+
+// An asynchronous send finished: account for it and send what queued up meanwhile
+void Server::handleSendDone(int client_fd, uint64_t tag, int result) {
+    if (orphaned_sends.erase(tag)) return;  // the connection closed in the meantime
+    Connection* slot = findConnection(client_fd);
+    if (!slot || slot->send_tag != tag) return;
+    Connection& conn = *slot;
+    conn.send_tag = 0;
+
+    if (result == -EAGAIN || result == -EINTR) {
+        // Socket buffer full: wait for EPOLLOUT, then resubmit
+        setWriteInterest(client_fd, true);
+        return;
+    }
+    if (result < 0) {
+        stats.outbound_bytes.add(-(int64_t)conn.outbound.size());
+        conn.outbound.clear();
+        shutdown(client_fd, SHUT_RDWR);
+        return;
+    }
+
+    size_t queued = conn.outbound.size();
+    conn.outbound.complete(result);
+    stats.bytes_out.add(result);
+    stats.outbound_bytes.add((int64_t)conn.outbound.size() - (int64_t)queued);
+    flushOutbound(client_fd);
+}
+
+void Server::setWriteInterest(int client_fd, bool enabled, bool rearm) {
+    Connection& conn = connections[client_fd];
+    if (conn.write_armed == enabled && !(enabled && rearm && edge_triggered)) return;
+    conn.write_armed = enabled;
+    if (enabled && conn.stall_timer == NO_TIMER) {
+        conn.stall_mark = conn.outbound.sentTotal();
+        armTimer(conn.stall_timer, client_fd, TimerKind::WRITE_STALL, ChatConfig::WRITE_STALL_TIMEOUT);
+    }
+    applyInterest(client_fd, conn);
+}
+
+void Server::setReadInterest(int client_fd, bool enabled) {
+    Connection& conn = connections[client_fd];
+    if (conn.read_paused == !enabled) return;
+    conn.read_paused = !enabled;
+    applyInterest(client_fd, conn);
+}
+
+void Server::applyInterest(int client_fd, const Connection& conn) {
+    uint32_t events = conn.read_paused ? (client_events & EPOLLET) : client_events;
+    if (conn.write_armed) events |= EPOLLOUT;
+    io->modify(client_fd, events);
+}
+
+// Move upload bytes from the sender's socket into the relay pipe. Returns true
+// once the upload is done and the socket carries commands again.
+bool Server::pumpUpload(int client_fd) {
+    Connection& conn = connections[client_fd];
+    Upload& up = *conn.upload;
+    int budget = edge_triggered ? ChatConfig::MAX_READS_PER_EVENT : 1;
+
+    for (int moves = 0; up.remaining > 0; ++moves) {
+        ssize_t n;
+        if (completion_reads || conn.ws) {
+            // io_uring already received the bytes, or they came unwrapped out of
+            // WebSocket frames (and were counted either way): copy them in
+            if (conn.inbound.empty()) return false;
+            n = write(up.pipe_in->fd, conn.inbound.data(), std::min<uint64_t>(up.remaining, conn.inbound.size()));
+            if (n > 0) {
+                conn.inbound.consume(n);
+                up.remaining -= n;
+                continue;
             }
         } else {
-            // Size provided - traditional mode (filename + size, client sends data)
-            filename = filepath_or_filename;
-            try {
-                filesize = std::stoi(size_param);
-            } catch (const std::exception& e) {
-                sendMessage(client_fd, "Error: Invalid file size '" + size_param + "'");
-                return;
-            }
-        }
-        
-        // Notify receiver
-        sendMessage(target_fd, "[File incoming] " + filename + " from " + clients[client_fd] +
-                            " (" + std::to_string(filesize) + " bytes)");
-        
-        if (is_filepath) {
-            // Server-side file reading and streaming
-            std::ifstream file(filepath_or_filename, std::ios::binary);
-            if (!file.is_open()) {
-                sendMessage(client_fd, "Error: Cannot open file '" + filepath_or_filename + "'");
-                sendMessage(target_fd, "Error: File transfer from " + clients[client_fd] + " failed.");
-                return;
-            }
-            
-            // Stream file directly from disk to target
-            char buffer[1024];
-            int remaining = filesize;
-            
-            while (remaining > 0 && file.good()) {
-                int chunk_size = std::min((int)sizeof(buffer), remaining);
-                file.read(buffer, chunk_size);
-                int bytes_read = file.gcount();
-                
-                if (bytes_read <= 0) break;
-                
-                int bytes_sent = send(target_fd, buffer, bytes_read, 0);
-                if (bytes_sent <= 0) {
-                    sendMessage(client_fd, "Error: Failed to send file data to " + target);
-                    sendMessage(target_fd, "Error: File transfer from " + clients[client_fd] + " interrupted.");
-                    file.close();
-                    return;
+            if (moves == budget) {
+                if (edge_triggered && !conn.read_pending) {
+                    conn.read_pending = true;
+                    pending_reads.push_back(client_fd);
                 }
-                
-                remaining -= bytes_sent;
+                return false;
             }
-            
-            file.close();
-            
-            if (remaining > 0) {
-                sendMessage(client_fd, "Error: File transfer incomplete.");
-                sendMessage(target_fd, "Error: File transfer from " + clients[client_fd] + " incomplete.");
-                return;
-            }
-            
-            // Success
-            sendMessage(client_fd, "File '" + filename + "' sent successfully to " + target);
-            sendMessage(target_fd, "File '" + filename + "' received successfully from " + clients[client_fd]);
-            logMessage("File transfer: " + clients[client_fd] + " -> " + target + " (" + filename + ", " + std::to_string(filesize) + " bytes)");
-            
-        } else {
-            // Traditional mode - expect client to send file data
-            // Look for leftover bytes after header
-            size_t newline_pos = msg.find('\n');
-            std::string leftover;
-            if (newline_pos != std::string::npos) {
-                leftover = msg.substr(newline_pos + 1);
-            }
-            
-            char buffer[1024];
-            int remaining = filesize;
-            
-            // Use leftover first
-            if (!leftover.empty()) {
-                int chunk = std::min((int)leftover.size(), remaining);
-                send(target_fd, leftover.data(), chunk, 0);
-                remaining -= chunk;
+
+            size_t want = std::min<uint64_t>(up.remaining, RELAY_PIPE_SIZE);
+            n = splice(client_fd, nullptr, up.pipe_in->fd, nullptr, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                up.remaining -= n;
+                conn.last_active = timers.now();
+                stats.bytes_in.add(n);
+                continue;
             }
-            
-            // Stream rest directly from client
-            while (remaining > 0) {
-                int n = recv(client_fd, buffer, std::min((int)sizeof(buffer), remaining), 0);
-                if (n <= 0) {
-                    if (remaining > 0) {
-                        sendMessage(client_fd, "Error: File transfer interrupted.");
-                        sendMessage(target_fd, "Error: File transfer from " + clients[client_fd] + " failed.");
-                    }
-                    return;
-                }
-                send(target_fd, buffer, n, 0);
-                remaining -= n;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Either the sender is idle (wait for EPOLLIN) or the receiver is behind
+            // and the pipe is full: stop reading the sender until it drains
+            pollfd pfd{up.pipe_in->fd, POLLOUT, 0};
+            if (poll(&pfd, 1, 0) == 0) {
+                setReadInterest(client_fd, false);
+                watchPipe(up.pipe_in->fd, EPOLLOUT, client_fd);
             }
-            
-            // Success
-            sendMessage(client_fd, "File '" + filename + "' sent successfully to " + target);
-            sendMessage(target_fd, "File '" + filename + "' received successfully from " + clients[client_fd]);
+            return false;
         }
-        
-        return;
+        if (n < 0 && errno == EPIPE) {
+            // Receiver went away: discard the rest of the upload as it arrives
+            conn.skip_bytes = up.remaining;
+            conn.upload.reset();
+            setReadInterest(client_fd, true);
+            sendError(client_fd, "Error: File transfer interrupted.");
+            return true;
+        }
+
+        // Sender hung up or failed mid-upload
+        removeClient(client_fd);
+        return false;
     }
 
+    sendMessage(client_fd, "File '" + up.filename + "' queued for delivery to " + up.target_name, MessageType::ACK);
+    deliver(up.target, "File '" + up.filename + "' received successfully from " + conn.username, MessageType::ACK);
+    conn.upload.reset();
+    return true;
+}
 
+void Server::watchPipe(int pipe_fd, uint32_t events, int client_fd) {
+    if ((size_t)pipe_fd >= pipe_owner.size()) pipe_owner.resize(std::max<size_t>(pipe_fd + 1, pipe_owner.size() * 2), -1);
+    pipe_owner[pipe_fd] = client_fd;
 
+    // One-shot; the owner re-arms it each time it stalls on the pipe again
+    if (!io->modify(pipe_fd, events | EPOLLONESHOT)) io->add(pipe_fd, events | EPOLLONESHOT);
+}
 
+void Server::handlePipeReady(int pipe_fd) {
+    if ((size_t)pipe_fd >= pipe_owner.size() || pipe_owner[pipe_fd] == -1) return;
+    int client_fd = pipe_owner[pipe_fd];
+    pipe_owner[pipe_fd] = -1;
 
+    Connection* conn = findConnection(client_fd);
+    if (!conn) return;
+    if (conn->upload && conn->upload->pipe_in->fd == pipe_fd) {
+        // The receiver made room: resume reading the sender
+        setReadInterest(client_fd, true);
+        handleClientInput(client_fd);
+    } else {
+        // The sender filled the pipe a receiver was starved on
+        flushOutbound(client_fd);
+    }
+}
 
+void Server::armTimer(TimerId& slot, int client_fd, TimerKind kind, int timeout_ms) {
+    if (timeout_ms > 0) slot = timers.schedule(ticksFor(timeout_ms), client_fd, (int)kind);
+}
 
+void Server::handleTimers() {
+    uint64_t expirations;
+    read(timer_fd, &expirations, sizeof(expirations));
 
-    // Broadcast normal message
-    std::cout << sender << ": " << msg << std::endl;
-    broadcastMessage(sender + ": " + msg, client_fd);
-    logMessage(sender + ": " + msg);
-}
+    // Ticks are read off the clock, so a late wakeup catches up instead of drifting
+    expired_timers.clear();
+    timers.advance(currentTick(), expired_timers);
 
-void Server::removeClient(int client_fd) {
-    std::string name = clients[client_fd];
-    if (!name.empty()) {
-        username_fd_map.erase(name);
+    // Fired ids are already released; drop them from their connections before
+    // any handler runs, or tearing down one connection would cancel them again
+    size_t claimed = 0;
+    for (const ExpiredTimer& timer : expired_timers)
+        if (claimTimer(timer)) expired_timers[claimed++] = timer;
+    expired_timers.resize(claimed);
 
-        // mark offline
-        auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-        user_status_map[name] = "offline since " + std::string(std::ctime(&now));
-        user_status_map[name].pop_back(); // remove newline
+    for (const ExpiredTimer& timer : expired_timers) onTimer(timer);
+}
 
-        std::cout << "Client disconnected: " << name << std::endl;
-        logMessage("Client disconnected: " + name);
+bool Server::claimTimer(const ExpiredTimer& timer) {
+    if ((TimerKind)timer.kind == TimerKind::HOUSEKEEPING) return true;
+    Connection* conn = findConnection(timer.owner);
+    if (!conn) return false;
+    TimerId* slot = nullptr;
+    switch ((TimerKind)timer.kind) {
+    case TimerKind::IDLE: slot = &conn->idle_timer; break;
+    case TimerKind::WRITE_STALL: slot = &conn->stall_timer; break;
+    case TimerKind::UPLOAD: slot = &conn->upload_timer; break;
+    default: return false;
     }
-
-    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
-    close(client_fd);
-    clients.erase(client_fd);
+    if (*slot != timer.id) return false;
+    *slot = NO_TIMER;
+    return true;
 }
 
+void Server::onTimer(const ExpiredTimer& timer) {
+    if ((TimerKind)timer.kind == TimerKind::HOUSEKEEPING) {
+        housekeeping();
+        timers.schedule(ticksFor(ChatConfig::HOUSEKEEPING_INTERVAL), -1, timer.kind);
+        return;
+    }
 
+    // An earlier timer in this batch may have closed the connection
+    int client_fd = timer.owner;
+    Connection* slot = findConnection(client_fd);
+    if (!slot) return;
+    Connection& conn = *slot;
 
-void Server::broadcastMessage(const std::string& msg, int exclude_fd) {
-    for (auto& [fd, name] : clients) {
-        if (fd != exclude_fd) sendMessage(fd, msg);
+    switch ((TimerKind)timer.kind) {
+    case TimerKind::IDLE: {
+        uint64_t idle = timers.now() - conn.last_active;
+        uint64_t limit = ticksFor(ChatConfig::CLIENT_INACTIVITY_TIMEOUT);
+        // A client that only reads is still there as long as its output drains
+        if (idle >= limit && conn.outbound.sentTotal() != conn.idle_mark) {
+            conn.idle_mark = conn.outbound.sentTotal();
+            conn.idle_timer = timers.schedule(limit, client_fd, timer.kind);
+            return;
+        }
+        if (idle < limit) {
+            conn.idle_timer = timers.schedule(limit - idle, client_fd, timer.kind);
+            return;
+        }
+        logMessage("Client " + std::to_string(client_fd) + " timed out after inactivity" +
+                   (conn.username.empty() ? "" : ": " + conn.username));
+        sendError(client_fd, "Error: Disconnected after inactivity.");
+        removeClient(client_fd);
+        return;
+    }
+    case TimerKind::WRITE_STALL:
+        if ((!conn.write_armed && !conn.send_tag) || conn.outbound.empty()) return;
+        if (conn.outbound.sentTotal() != conn.stall_mark) {
+            conn.stall_mark = conn.outbound.sentTotal();
+            armTimer(conn.stall_timer, client_fd, TimerKind::WRITE_STALL, ChatConfig::WRITE_STALL_TIMEOUT);
+            return;
+        }
+        logMessage("Client " + std::to_string(client_fd) + " dropped: output stalled" +
+                   (conn.username.empty() ? "" : ": " + conn.username));
+        removeClient(client_fd);
+        return;
+    case TimerKind::UPLOAD:
+        if (!conn.upload) return;
+        // A sender paused on a full relay pipe is waiting on the receiver, whose stall timer covers it
+        if (conn.upload->remaining != conn.upload_mark || conn.read_paused) {
+            conn.upload_mark = conn.upload->remaining;
+            armTimer(conn.upload_timer, client_fd, TimerKind::UPLOAD, ChatConfig::FILE_TRANSFER_TIMEOUT);
+            return;
+        }
+        sendError(client_fd, "Error: File transfer timed out.");
+        removeClient(client_fd);
+        return;
+    default:
+        return;
     }
 }
 
-void Server::sendMessage(int client_fd, const std::string& msg) {
-    send(client_fd, msg.c_str(), msg.size(), 0);
+// Periodic cleanup: give back input buffers of connections that went quiet,
+// and (once, on shard 0) expire offline presence entries
+void Server::housekeeping() {
+    uint64_t quiet = ticksFor(ChatConfig::HOUSEKEEPING_INTERVAL);
+    for (int fd : live_fds) {
+        Connection& conn = connectionOf(fd);
+        if (timers.now() - conn.last_active < quiet) continue;
+        if (conn.inbound.empty() && conn.inbound.capacity() > 0) conn.inbound.release();
+        if (conn.ws && conn.ws->raw.empty() && conn.ws->raw.capacity() > 0) conn.ws->raw.release();
+    }
+    if (shard_index == 0) registry.evictOfflineNow();
+    rollConsoleWindow();
 }
 
 } // namespace ChatServer
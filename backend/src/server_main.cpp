@@ -1,29 +1,42 @@
-#include "server.hpp"
+#include "server_pool.hpp"
+#include "config.hpp"
 #include <iostream>
 #include <csignal>
+#include <atomic>
+#include <sys/resource.h>
 
-ChatServer::Server* g_server = nullptr;
+static std::atomic<ChatServer::ServerPool*> running_pool{nullptr};
 
-// Optional: Handle Ctrl+C to gracefully shut down server
-void signalHandler(int signum) {
-    std::cout << "\nShutting down server..." << std::endl;
-    if (g_server) {
-        delete g_server;
-        g_server = nullptr;
-    }
-    exit(EXIT_SUCCESS);
+// Ctrl+C / SIGTERM: let the reactors return so the pool's destructor
+// flushes the log and the message store, instead of exit()ing past them
+void signalHandler(int) {
+    if (ChatServer::ServerPool* pool = running_pool.load()) pool->stop();
 }
 
-int main() {
-    std::signal(SIGINT, signalHandler);
+int main(int argc, char* argv[]) {
+    // sendfile() has no MSG_NOSIGNAL; a dead peer must not kill the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    ChatConfig::loadConfig(argc > 1 ? argv[1] : "config.json");
+
+    // Reconnect storms need far more descriptors than the usual soft limit of 1024
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
 
     try {
-        ChatServer::Server server;
-        g_server = &server;
+        ChatServer::ServerPool pool(ChatConfig::WORKER_THREADS);
+        running_pool = &pool;
+        std::signal(SIGINT, signalHandler);
+        std::signal(SIGTERM, signalHandler);
 
         std::cout << "Starting Chat Server on port 12345..." << std::endl;
 
-        server.run();
+        pool.run();
+        std::cout << "\nShutting down server..." << std::endl;
+        running_pool = nullptr;
 
     } catch (const std::exception& e) {
         std::cerr << "Server exception: " << e.what() << std::endl;
@@ -0,0 +1,48 @@
+#include "server_pool.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+namespace ChatServer {
+
+ServerPool::ServerPool(int worker_threads) {
+    if (worker_threads <= 0) worker_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    logger = std::make_unique<Logger>(ChatConfig::LOG_FILE, ChatConfig::LOG_QUEUE_CAPACITY,
+                                      ChatConfig::LOG_MAX_BYTES, ChatConfig::LOG_MAX_FILES);
+    metrics = std::make_unique<Metrics>(worker_threads, Server::handlerNames(), *logger);
+    registry = std::make_unique<Registry>(worker_threads);
+    history = std::make_unique<HistoryStore>(std::max(0, ChatConfig::HISTORY_SIZE),
+                                             std::max(0, ChatConfig::HISTORY_MEMORY_BUDGET));
+    if (!ChatConfig::STORE_DIR.empty())
+        store = std::make_unique<MessageStore>(ChatConfig::STORE_DIR, std::max(0, ChatConfig::STORE_SEGMENT_BYTES),
+                                               ChatConfig::STORE_MAX_SEGMENTS);
+    for (int i = 0; i < worker_threads; ++i) {
+        shards.push_back(std::make_unique<Server>(i, *registry, *logger, *metrics, *history, store.get()));
+        registry->attachShard(i, shards.back().get());
+    }
+
+    if (!ChatConfig::ADMIN_SOCKET.empty()) {
+        stats_socket = std::make_unique<StatsSocket>(ChatConfig::ADMIN_SOCKET, *metrics);
+        std::cout << "Stats available on unix socket " << ChatConfig::ADMIN_SOCKET << std::endl;
+    }
+
+    std::cout << "Chat Server running " << worker_threads << " reactor shard(s)" << std::endl;
+}
+
+void ServerPool::run() {
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < shards.size(); ++i)
+        workers.emplace_back([shard = shards[i].get()]() { shard->run(); });
+
+    shards[0]->run();
+
+    for (auto& worker : workers) worker.join();
+}
+
+void ServerPool::stop() {
+    for (auto& shard : shards) shard->stop();
+}
+
+} // namespace ChatServer
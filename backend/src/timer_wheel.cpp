@@ -0,0 +1,88 @@
+#include "timer_wheel.hpp"
+#include <algorithm>
+
+namespace ChatServer {
+
+TimerId TimerWheel::schedule(uint64_t delay, int owner, int kind) {
+    TimerId id;
+    if (free_head != NO_TIMER) {
+        id = free_head;
+        free_head = nodes[id].next;
+    } else {
+        id = nodes.size();
+        nodes.emplace_back();
+    }
+
+    Node& node = nodes[id];
+    node.expires = current + std::clamp<uint64_t>(delay, 1, MAX_DELAY);
+    node.owner = owner;
+    node.kind = kind;
+    link(id);
+    ++active;
+    return id;
+}
+
+void TimerWheel::cancel(TimerId id) {
+    unlink(id);
+    nodes[id].next = free_head;
+    free_head = id;
+    --active;
+}
+
+// Level = how many 6-bit digits separate expiry from now; slot = that digit of the expiry
+void TimerWheel::link(TimerId id) {
+    Node& node = nodes[id];
+    uint64_t delta = node.expires - current;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1ull << (LEVEL_BITS * (level + 1)))) ++level;
+
+    node.slot = level * SLOTS + ((node.expires >> (LEVEL_BITS * level)) & (SLOTS - 1));
+    node.prev = NO_TIMER;
+    node.next = heads[node.slot];
+    if (node.next != NO_TIMER) nodes[node.next].prev = id;
+    heads[node.slot] = id;
+}
+
+void TimerWheel::unlink(TimerId id) {
+    Node& node = nodes[id];
+    if (node.prev != NO_TIMER) nodes[node.prev].next = node.next;
+    else heads[node.slot] = node.next;
+    if (node.next != NO_TIMER) nodes[node.next].prev = node.prev;
+}
+
+// Re-file the current slot of `level`; everything in it is now due within one lap of the level below
+void TimerWheel::cascade(int level) {
+    uint32_t slot = level * SLOTS + ((current >> (LEVEL_BITS * level)) & (SLOTS - 1));
+    TimerId id = heads[slot];
+    heads[slot] = NO_TIMER;
+    while (id != NO_TIMER) {
+        TimerId next = nodes[id].next;
+        link(id);
+        id = next;
+    }
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<ExpiredTimer>& expired) {
+    while (current < now) {
+        ++current;
+        for (int level = 1; level < LEVELS; ++level) {
+            if (current & ((1ull << (LEVEL_BITS * level)) - 1)) break;
+            cascade(level);
+        }
+
+        uint32_t slot = current & (SLOTS - 1);
+        TimerId id = heads[slot];
+        heads[slot] = NO_TIMER;
+        while (id != NO_TIMER) {
+            Node& node = nodes[id];
+            TimerId next = node.next;
+            expired.push_back({id, node.owner, node.kind});
+            node.next = free_head;
+            free_head = id;
+            --active;
+            id = next;
+        }
+    }
+}
+
+} // namespace ChatServer
@@ -20,4 +20,18 @@ std::string trim(const std::string& str) {
     return s;
 }
 
+std::string_view trimView(std::string_view str) {
+    size_t start = 0, end = str.size();
+    while (start < end && std::isspace((unsigned char)str[start])) ++start;
+    while (end > start && std::isspace((unsigned char)str[end - 1])) --end;
+    return str.substr(start, end - start);
+}
+
+std::pair<std::string_view, std::string_view> splitToken(std::string_view str) {
+    str = trimView(str);
+    size_t space = str.find_first_of(" \t");
+    if (space == std::string_view::npos) return {str, std::string_view()};
+    return {str.substr(0, space), trimView(str.substr(space + 1))};
+}
+
 } // namespace ChatServer
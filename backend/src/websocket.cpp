@@ -0,0 +1,193 @@
+#include "websocket.hpp"
+#include <cstring>
+#include <cctype>
+
+namespace ChatServer {
+
+// Handshakes longer than this are refused rather than buffered
+static constexpr size_t MAX_REQUEST = 8192;
+
+static constexpr std::string_view ACCEPT_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+const char* const UPGRADE_REJECTED =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n\r\n";
+
+WebSocketFrame::Decode WebSocketFrame::decodeHeader(std::string_view buffer, WebSocketFrame& out) {
+    if (buffer.size() < 2) return Decode::INCOMPLETE;
+    uint8_t b0 = buffer[0], b1 = buffer[1];
+    out.fin = b0 & 0x80;
+    out.opcode = b0 & 0x0F;
+    if ((b0 & 0x70) || !(b1 & 0x80)) return Decode::INVALID;  // reserved bits, unmasked
+    if (out.opcode > BINARY && out.opcode < CLOSE) return Decode::INVALID;
+    if (out.opcode > PONG) return Decode::INVALID;
+
+    uint64_t length = b1 & 0x7F;
+    size_t at = 2;
+    if (length == 126 || length == 127) {
+        size_t bytes = length == 126 ? 2 : 8;
+        if (buffer.size() < at + bytes) return Decode::INCOMPLETE;
+        length = 0;
+        for (size_t i = 0; i < bytes; ++i) length = length << 8 | (uint8_t)buffer[at + i];
+        at += bytes;
+        if (length >> 63) return Decode::INVALID;
+    }
+    if (out.isControl() && (!out.fin || length > MAX_CONTROL)) return Decode::INVALID;
+
+    if (buffer.size() < at + 4) return Decode::INCOMPLETE;
+    std::memcpy(out.mask.data(), buffer.data() + at, 4);
+    out.length = length;
+    out.header_size = at + 4;
+    return Decode::OK;
+}
+
+size_t WebSocketFrame::encodeHeader(char* out, uint8_t opcode, uint64_t length) {
+    out[0] = (char)(0x80 | opcode);
+    if (length < 126) {
+        out[1] = (char)length;
+        return 2;
+    }
+    size_t bytes = length <= UINT16_MAX ? 2 : 8;
+    out[1] = (char)(bytes == 2 ? 126 : 127);
+    for (size_t i = 0; i < bytes; ++i) out[1 + bytes - i] = (char)(length >> (8 * i));
+    return 2 + bytes;
+}
+
+void WebSocketFrame::unmask(char* data, size_t len, const std::array<uint8_t, 4>& mask, uint64_t offset) {
+    // Rotate the key to the payload offset, then XOR eight bytes at a time
+    uint8_t key[8];
+    for (size_t i = 0; i < 8; ++i) key[i] = mask[(offset + i) & 3];
+    uint64_t wide;
+    std::memcpy(&wide, key, 8);
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t chunk;
+        std::memcpy(&chunk, data + i, 8);
+        chunk ^= wide;
+        std::memcpy(data + i, &chunk, 8);
+    }
+    for (; i < len; ++i) data[i] ^= key[i & 7];
+}
+
+// SHA-1 (FIPS 180-4); only the handshake uses it, so small beats fast
+static std::array<uint8_t, 20> sha1(std::string_view input) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    auto rotl = [](uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+
+    std::string data(input);
+    uint64_t bits = (uint64_t)input.size() * 8;
+    data += (char)0x80;
+    while (data.size() % 64 != 56) data += '\0';
+    for (int i = 7; i >= 0; --i) data += (char)(bits >> (8 * i));
+
+    for (size_t block = 0; block < data.size(); block += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            const uint8_t* p = (const uint8_t*)data.data() + block + 4 * i;
+            w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        }
+        for (int i = 16; i < 80; ++i) w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+            uint32_t t = rotl(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rotl(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+    std::array<uint8_t, 20> digest;
+    for (int i = 0; i < 20; ++i) digest[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+    return digest;
+}
+
+static std::string base64(const uint8_t* data, size_t len) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t n = (uint32_t)data[i] << 16;
+        if (i + 1 < len) n |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < len) n |= data[i + 2];
+        out += alphabet[n >> 18 & 63];
+        out += alphabet[n >> 12 & 63];
+        out += i + 1 < len ? alphabet[n >> 6 & 63] : '=';
+        out += i + 2 < len ? alphabet[n & 63] : '=';
+    }
+    return out;
+}
+
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i])) return false;
+    return true;
+}
+
+static std::string_view trimSpaces(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// Comma-separated header value containing `token`, e.g. "keep-alive, Upgrade"
+static bool hasToken(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        if (equalsIgnoreCase(trimSpaces(value.substr(0, comma)), token)) return true;
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+WebSocketFrame::Decode parseUpgradeRequest(std::string_view buffer, std::string_view& key, size_t& request_size) {
+    size_t end = buffer.find("\r\n\r\n");
+    if (end == std::string_view::npos)
+        return buffer.size() > MAX_REQUEST ? WebSocketFrame::Decode::INVALID : WebSocketFrame::Decode::INCOMPLETE;
+    request_size = end + 4;
+
+    std::string_view request = buffer.substr(0, end + 2);
+    size_t line_end = request.find("\r\n");
+    std::string_view request_line = request.substr(0, line_end);
+    if (request_line.substr(0, 4) != "GET " || request_line.find(" HTTP/1.1") == std::string_view::npos)
+        return WebSocketFrame::Decode::INVALID;
+
+    bool upgrade = false, connection = false, version = false;
+    key = {};
+    for (size_t at = line_end + 2; at < request.size();) {
+        size_t next = request.find("\r\n", at);
+        std::string_view line = request.substr(at, next - at);
+        at = next + 2;
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) continue;
+        std::string_view name = trimSpaces(line.substr(0, colon));
+        std::string_view value = trimSpaces(line.substr(colon + 1));
+        if (equalsIgnoreCase(name, "Upgrade")) upgrade = equalsIgnoreCase(value, "websocket");
+        else if (equalsIgnoreCase(name, "Connection")) connection = hasToken(value, "upgrade");
+        else if (equalsIgnoreCase(name, "Sec-WebSocket-Version")) version = value == "13";
+        else if (equalsIgnoreCase(name, "Sec-WebSocket-Key")) key = value;
+    }
+    if (!upgrade || !connection || !version || key.empty()) return WebSocketFrame::Decode::INVALID;
+    return WebSocketFrame::Decode::OK;
+}
+
+std::string upgradeResponse(std::string_view key) {
+    std::string challenge(key);
+    challenge += ACCEPT_GUID;
+    std::array<uint8_t, 20> digest = sha1(challenge);
+    return "HTTP/1.1 101 Switching Protocols\r\n"
+           "Upgrade: websocket\r\n"
+           "Connection: Upgrade\r\n"
+           "Sec-WebSocket-Accept: " + base64(digest.data(), digest.size()) + "\r\n\r\n";
+}
+
+} // namespace ChatServer
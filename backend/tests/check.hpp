@@ -0,0 +1,26 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <cstdio>
+
+// Minimal checks for the unit tests: one executable per file, run by ctest.
+// A failed CHECK is reported and counted; the test keeps going.
+namespace ChatTest {
+    inline int failures = 0;
+
+    inline int finish(const char* suite) {
+        if (failures) std::fprintf(stderr, "%s: %d check(s) failed\n", suite, failures);
+        else std::printf("%s: ok\n", suite);
+        return failures ? 1 : 0;
+    }
+}
+
+#define CHECK(cond)                                                                      \
+    do {                                                                                 \
+        if (!(cond)) {                                                                   \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++ChatTest::failures;                                                        \
+        }                                                                                \
+    } while (0)
+
+#endif // CHECK_HPP
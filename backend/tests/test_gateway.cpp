@@ -0,0 +1,85 @@
+#include "gateway.hpp"
+#include "message.hpp"
+#include "check.hpp"
+#include <string>
+#include <vector>
+
+using namespace ChatServer;
+
+static std::string frame(uint32_t session, uint8_t op, const std::string& payload, uint8_t type = 0) {
+    std::string out(GatewayFrame::HEADER_SIZE, '\0');
+    GatewayFrame::encodeHeader(out.data(), payload.size(), session, op, type);
+    return out + payload;
+}
+
+// Big-endian length and session, then op and type
+static void testLayout() {
+    char out[GatewayFrame::HEADER_SIZE];
+    GatewayFrame::encodeHeader(out, 0x01020304, 0xA0B0C0D0, GatewayFrame::DATA, (uint8_t)MessageType::ERROR);
+    const unsigned char expected[] = {1, 2, 3, 4, 0xA0, 0xB0, 0xC0, 0xD0, GatewayFrame::DATA, (uint8_t)MessageType::ERROR};
+    CHECK(std::string(out, sizeof(out)) == std::string((const char*)expected, sizeof(expected)));
+}
+
+static void testRoundTrip() {
+    const uint32_t sessions[] = {0, 1, 255, 65536, UINT32_MAX};
+    for (uint32_t session : sessions) {
+        for (uint8_t op = GatewayFrame::OPEN; op <= GatewayFrame::CLOSE_MANY; ++op) {
+            char out[GatewayFrame::HEADER_SIZE];
+            GatewayFrame::encodeHeader(out, GatewayFrame::MAX_PAYLOAD, session, op, 7);
+            GatewayFrame header;
+            CHECK(GatewayFrame::decodeHeader(std::string_view(out, sizeof(out)), header));
+            CHECK(header.length == GatewayFrame::MAX_PAYLOAD && header.session == session);
+            CHECK(header.op == op && header.type == 7);
+        }
+    }
+    // The type defaults to 0, as the gateway sends it
+    char out[GatewayFrame::HEADER_SIZE];
+    GatewayFrame::encodeHeader(out, 0, 9, GatewayFrame::CLOSE);
+    GatewayFrame header;
+    CHECK(GatewayFrame::decodeHeader(std::string_view(out, sizeof(out)), header) && header.type == 0);
+}
+
+static void testShortBuffer() {
+    std::string bytes = frame(42, GatewayFrame::OPEN, "alice");
+    GatewayFrame header;
+    header.session = 99;
+    for (size_t n = 0; n < GatewayFrame::HEADER_SIZE; ++n)
+        CHECK(!GatewayFrame::decodeHeader(std::string_view(bytes).substr(0, n), header));
+    CHECK(header.session == 99);  // untouched until a whole header is there
+    // The header alone is enough; the payload may still be arriving
+    CHECK(GatewayFrame::decodeHeader(std::string_view(bytes).substr(0, GatewayFrame::HEADER_SIZE), header));
+    CHECK(header.session == 42 && header.length == 5);
+}
+
+// Walk a stream of back-to-back frames the way the server reads them
+static void testStream() {
+    std::string stream = frame(1, GatewayFrame::OPEN, "alice")
+                       + frame(1, GatewayFrame::DATA, "hello\n")
+                       + frame(2, GatewayFrame::CREDIT, std::string("\0\0\x10\0", 4))
+                       + frame(1, GatewayFrame::CLOSE, "");
+    std::vector<GatewayFrame> headers;
+    std::vector<std::string> payloads;
+    std::string_view rest = stream;
+    GatewayFrame header;
+    while (GatewayFrame::decodeHeader(rest, header)) {
+        CHECK(rest.size() >= GatewayFrame::HEADER_SIZE + header.length);
+        headers.push_back(header);
+        payloads.emplace_back(rest.substr(GatewayFrame::HEADER_SIZE, header.length));
+        rest.remove_prefix(GatewayFrame::HEADER_SIZE + header.length);
+    }
+    CHECK(rest.empty());
+    CHECK(headers.size() == 4);
+    if (headers.size() != 4) return;
+    CHECK(headers[0].op == GatewayFrame::OPEN && payloads[0] == "alice");
+    CHECK(headers[1].op == GatewayFrame::DATA && payloads[1] == "hello\n");
+    CHECK(headers[2].session == 2 && getU32(payloads[2].data()) == 4096);
+    CHECK(headers[3].op == GatewayFrame::CLOSE && headers[3].length == 0);
+}
+
+int main() {
+    testLayout();
+    testRoundTrip();
+    testShortBuffer();
+    testStream();
+    return ChatTest::finish("gateway");
+}
@@ -0,0 +1,113 @@
+#include "history.hpp"
+#include "check.hpp"
+#include <string>
+#include <vector>
+
+using namespace ChatServer;
+
+static constexpr size_t UNLIMITED = SIZE_MAX / 2;
+
+// Slab storage per ring of `capacity` lines (HistoryStore::Entry is a line and a seq)
+static size_t slabBytes(size_t capacity) {
+    return 64 * capacity * (sizeof(SharedBuffer) + sizeof(uint64_t));
+}
+
+static std::vector<std::string> recentText(const HistoryStore& history, uint32_t channel, size_t count) {
+    std::vector<SharedBuffer> lines;
+    history.recent(channel, count, lines);
+    std::vector<std::string> text;
+    for (const SharedBuffer& line : lines) text.push_back(*line);
+    return text;
+}
+
+static void testRingOverwrite() {
+    HistoryStore history(3, UNLIMITED);
+    CHECK(recentText(history, HistoryStore::GLOBAL, 5).empty());
+
+    SharedBuffer first = makeBuffer("m0");
+    history.append(HistoryStore::GLOBAL, first);
+    std::vector<SharedBuffer> lines;
+    history.recent(HistoryStore::GLOBAL, 1, lines);
+    CHECK(lines.size() == 1 && lines[0] == first);  // the shared payload itself, not a copy
+
+    for (int i = 1; i < 5; ++i) history.append(HistoryStore::GLOBAL, makeBuffer("m" + std::to_string(i)));
+    CHECK((recentText(history, HistoryStore::GLOBAL, 10) == std::vector<std::string>{"m2", "m3", "m4"}));
+    CHECK((recentText(history, HistoryStore::GLOBAL, 2) == std::vector<std::string>{"m3", "m4"}));
+    CHECK(recentText(history, HistoryStore::GLOBAL, 0).empty());
+}
+
+static void testChannelsAreSeparate() {
+    HistoryStore history(2, UNLIMITED);
+    uint32_t g0 = HistoryStore::channelOf(0), g9 = HistoryStore::channelOf(9);
+    history.append(g9, makeBuffer("nine"));
+    history.append(HistoryStore::GLOBAL, makeBuffer("main"));
+    history.append(g0, makeBuffer("zero"));
+
+    CHECK((recentText(history, g9, 5) == std::vector<std::string>{"nine"}));
+    CHECK((recentText(history, g0, 5) == std::vector<std::string>{"zero"}));
+    CHECK((recentText(history, HistoryStore::GLOBAL, 5) == std::vector<std::string>{"main"}));
+    CHECK(recentText(history, HistoryStore::channelOf(3), 5).empty());
+    CHECK(recentText(history, HistoryStore::channelOf(100), 5).empty());
+}
+
+static void testDisabled() {
+    HistoryStore off(0, UNLIMITED);
+    off.append(HistoryStore::GLOBAL, makeBuffer("x"));
+    CHECK(off.perChannel() == 0);
+    CHECK(recentText(off, HistoryStore::GLOBAL, 5).empty());
+
+    // A budget that can't hold one slab keeps nothing either
+    HistoryStore starved(4, slabBytes(4) - 1);
+    starved.append(HistoryStore::GLOBAL, makeBuffer("x"));
+    CHECK(recentText(starved, HistoryStore::GLOBAL, 5).empty());
+}
+
+// Past the budget the oldest lines go first, whichever channel holds them
+static void testBudgetEviction() {
+    const size_t capacity = 8;
+    HistoryStore history(capacity, slabBytes(capacity) + 40);  // room for four 10-byte lines
+    uint32_t a = HistoryStore::channelOf(0), b = HistoryStore::channelOf(1);
+
+    history.append(a, makeBuffer("a0--------"));
+    history.append(b, makeBuffer("b0--------"));
+    history.append(a, makeBuffer("a1--------"));
+    history.append(b, makeBuffer("b1--------"));
+    CHECK(recentText(history, a, 10).size() == 2);
+    CHECK(recentText(history, b, 10).size() == 2);
+
+    history.append(b, makeBuffer("b2--------"));
+    CHECK((recentText(history, a, 10) == std::vector<std::string>{"a1--------"}));
+    CHECK(recentText(history, b, 10).size() == 3);
+
+    history.append(b, makeBuffer("b3--------"));
+    history.append(b, makeBuffer("b4--------"));
+    CHECK(recentText(history, a, 10).empty());
+    CHECK((recentText(history, b, 10) == std::vector<std::string>{"b1--------", "b2--------", "b3--------", "b4--------"}));
+}
+
+// A busy channel overwriting its ring leaves stale eviction stamps behind;
+// a quiet channel's lines must still be the ones evicted first, and only once
+static void testStaleStampsAfterWrap() {
+    const size_t capacity = 2;
+    HistoryStore history(capacity, slabBytes(capacity) + 30);  // three 10-byte lines
+    uint32_t quiet = HistoryStore::channelOf(0), busy = HistoryStore::channelOf(1);
+
+    history.append(quiet, makeBuffer("q0--------"));
+    for (int i = 0; i < 1000; ++i) history.append(busy, makeBuffer("b" + std::to_string(i % 10) + "--------"));
+    CHECK((recentText(history, quiet, 5) == std::vector<std::string>{"q0--------"}));
+    CHECK(recentText(history, busy, 5).size() == 2);
+
+    history.append(busy, makeBuffer("bX--------"));
+    history.append(quiet, makeBuffer("q1--------"));
+    CHECK((recentText(history, quiet, 5) == std::vector<std::string>{"q1--------"}));
+    CHECK(recentText(history, busy, 5).size() == 2);
+}
+
+int main() {
+    testRingOverwrite();
+    testChannelsAreSeparate();
+    testDisabled();
+    testBudgetEviction();
+    testStaleStampsAfterWrap();
+    return ChatTest::finish("history");
+}
@@ -0,0 +1,150 @@
+#include "message.hpp"
+#include "check.hpp"
+#include <string>
+
+using namespace ChatServer;
+
+static void testRoundTrip() {
+    Message message;
+    message.type = MessageType::PRIVATE;
+    message.sender = "alice";
+    message.target = "bob";
+    message.content = "hello there";
+    std::string frame = message.serialize();
+    CHECK(frame.size() == message.encodedSize());
+    CHECK(frame.size() == Message::HEADER_SIZE + 5 + 3 + 11);
+
+    Message decoded;
+    size_t frame_size = 0;
+    CHECK(Message::decode(frame, 1024, decoded, frame_size) == Message::Decode::OK);
+    CHECK(frame_size == frame.size());
+    CHECK(decoded.type == MessageType::PRIVATE);
+    CHECK(decoded.sender == "alice");
+    CHECK(decoded.target == "bob");
+    CHECK(decoded.content == "hello there");
+
+    // Fields view the caller's buffer rather than copying
+    CHECK(decoded.content.data() == frame.data() + Message::HEADER_SIZE + 8);
+}
+
+static void testEmptyFields() {
+    Message message;
+    message.type = MessageType::COMMAND;
+    std::string frame = message.serialize();
+    CHECK(frame.size() == Message::HEADER_SIZE);
+
+    Message decoded;
+    size_t frame_size = 0;
+    CHECK(Message::decode(frame, 0, decoded, frame_size) == Message::Decode::OK);
+    CHECK(decoded.type == MessageType::COMMAND);
+    CHECK(decoded.sender.empty() && decoded.target.empty() && decoded.content.empty());
+}
+
+// Every strict prefix of a frame is incomplete, and a second frame behind
+// the first is left alone
+static void testPartialAndPipelined() {
+    Message first;
+    first.content = "one";
+    Message second;
+    second.type = MessageType::GROUP;
+    second.target = "g";
+    second.content = "two";
+    std::string stream = first.serialize() + second.serialize();
+    size_t first_size = first.encodedSize();
+
+    Message decoded;
+    size_t frame_size = 0;
+    for (size_t n = 0; n < first_size; ++n)
+        CHECK(Message::decode(std::string_view(stream).substr(0, n), 1024, decoded, frame_size) == Message::Decode::INCOMPLETE);
+
+    CHECK(Message::decode(stream, 1024, decoded, frame_size) == Message::Decode::OK);
+    CHECK(frame_size == first_size);
+    CHECK(decoded.content == "one");
+    CHECK(Message::decode(std::string_view(stream).substr(frame_size), 1024, decoded, frame_size) == Message::Decode::OK);
+    CHECK(decoded.type == MessageType::GROUP && decoded.target == "g" && decoded.content == "two");
+}
+
+static void testRejects() {
+    Message message;
+    message.content = std::string(100, 'x');
+    std::string frame = message.serialize();
+    Message decoded;
+    size_t frame_size = 0;
+
+    // Over the cap: reported from the length alone, with how much to skip
+    CHECK(Message::decode(std::string_view(frame).substr(0, 4), 99, decoded, frame_size) == Message::Decode::TOO_LARGE);
+    CHECK(frame_size == frame.size());
+    CHECK(Message::decode(frame, 100, decoded, frame_size) == Message::Decode::OK);
+
+    std::string bad_type = frame;
+    bad_type[4] = (char)MESSAGE_TYPE_COUNT;
+    CHECK(Message::decode(bad_type, 1024, decoded, frame_size) == Message::Decode::INVALID);
+    CHECK(frame_size == frame.size());
+
+    // Sender and target lengths that run past the body
+    std::string overrun = frame;
+    putU16(overrun.data() + 5, 60);
+    putU16(overrun.data() + 7, 60);
+    CHECK(Message::decode(overrun, 1024, decoded, frame_size) == Message::Decode::INVALID);
+
+    // A body too short to hold the type and field lengths
+    std::string short_body(Message::HEADER_SIZE, '\0');
+    putU32(short_body.data(), 2);
+    CHECK(Message::decode(short_body, 1024, decoded, frame_size) == Message::Decode::INVALID);
+}
+
+static void testDecodeHeader() {
+    Message message;
+    message.type = MessageType::FILE_CHUNK;
+    message.content = std::string(5000, 'b');
+    std::string frame = message.serialize();
+
+    MessageType type;
+    size_t sender_len, target_len, content_len;
+    CHECK(Message::decodeHeader(std::string_view(frame).substr(0, Message::HEADER_SIZE - 1), type, sender_len,
+                                target_len, content_len) == Message::Decode::INCOMPLETE);
+    // Only the header is needed, however much of the body has arrived
+    CHECK(Message::decodeHeader(std::string_view(frame).substr(0, Message::HEADER_SIZE), type, sender_len,
+                                target_len, content_len) == Message::Decode::OK);
+    CHECK(type == MessageType::FILE_CHUNK);
+    CHECK(sender_len == 0 && target_len == 0 && content_len == 5000);
+
+    frame[4] = (char)0xff;
+    CHECK(Message::decodeHeader(frame, type, sender_len, target_len, content_len) == Message::Decode::INVALID);
+}
+
+// A header written separately, followed by the fields, is the same frame
+static void testEncodeHeader() {
+    Message message;
+    message.type = MessageType::ACK;
+    message.sender = "s";
+    message.content = "shared payload";
+
+    std::string split(Message::HEADER_SIZE, '\0');
+    Message::encodeHeader(split.data(), message.type, 1, 0, message.content.size());
+    split += "s";
+    split += message.content;
+    CHECK(split == message.serialize());
+}
+
+static void testIntegers() {
+    char bytes[4];
+    putU32(bytes, 0x01020304);
+    CHECK(bytes[0] == 1 && bytes[1] == 2 && bytes[2] == 3 && bytes[3] == 4);
+    CHECK(getU32(bytes) == 0x01020304);
+    putU32(bytes, UINT32_MAX);
+    CHECK(getU32(bytes) == UINT32_MAX);
+    putU16(bytes, 0xfffe);
+    CHECK(getU16(bytes) == 0xfffe);
+}
+
+int main() {
+    testRoundTrip();
+    testEmptyFields();
+    testPartialAndPipelined();
+    testRejects();
+    testDecodeHeader();
+    testEncodeHeader();
+    testIntegers();
+    return ChatTest::finish("message");
+}
@@ -0,0 +1,206 @@
+#include "message_store.hpp"
+#include "check.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace ChatServer;
+
+static constexpr size_t SEGMENT_BYTES = 64 * 1024;  // the smallest the store allows
+
+struct TempDir {
+    std::string path;
+    TempDir() {
+        char name[] = "/tmp/chat_store_test.XXXXXX";
+        path = mkdtemp(name);
+    }
+    ~TempDir() {
+        for (const std::string& file : segments()) unlink((path + "/" + file).c_str());
+        rmdir(path.c_str());
+    }
+    std::vector<std::string> segments() const {
+        std::vector<std::string> names;
+        if (DIR* listing = opendir(path.c_str())) {
+            while (dirent* entry = readdir(listing))
+                if (std::string(entry->d_name).find(".seg") != std::string::npos) names.push_back(entry->d_name);
+            closedir(listing);
+        }
+        return names;
+    }
+};
+
+static std::vector<std::string> recentText(const MessageStore& store, std::string_view channel, size_t count) {
+    std::vector<SharedBuffer> lines;
+    store.recent(channel, count, lines);
+    std::vector<std::string> text;
+    for (const SharedBuffer& line : lines) text.push_back(*line);
+    return text;
+}
+
+// Appends become readable once the writer thread has written their batch
+static bool waitForLines(const MessageStore& store, std::string_view channel, size_t count) {
+    for (int i = 0; i < 200; ++i) {
+        if (recentText(store, channel, count).size() >= count) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+static std::string numbered(int i, size_t size = 0) {
+    std::string line = "line " + std::to_string(i) + " ";
+    if (line.size() < size) line.append(size - line.size(), '.');
+    return line;
+}
+
+static void testReadBack() {
+    TempDir dir;
+    MessageStore store(dir.path, SEGMENT_BYTES, 0);
+    CHECK(recentText(store, "", 10).empty());
+
+    for (int i = 0; i < 5; ++i) CHECK(store.append("", numbered(i)));
+    CHECK(store.append("g", "group line"));
+    CHECK(waitForLines(store, "", 5));
+    CHECK(waitForLines(store, "g", 1));
+
+    CHECK((recentText(store, "", 2) == std::vector<std::string>{numbered(3), numbered(4)}));
+    CHECK(recentText(store, "", 100).size() == 5);
+    CHECK((recentText(store, "g", 10) == std::vector<std::string>{"group line"}));
+    CHECK(recentText(store, "other", 10).empty());
+
+    // Larger than a segment can hold: refused, nothing queued
+    CHECK(!store.append("", std::string(SEGMENT_BYTES, 'x')));
+}
+
+// Everything written before a clean shutdown is there after a restart, and
+// sequence numbers carry on so new lines extend each channel's history
+static void testRecovery() {
+    TempDir dir;
+    {
+        MessageStore store(dir.path, SEGMENT_BYTES, 0);
+        for (int i = 0; i < 10; ++i) store.append("", numbered(i));
+        for (int i = 0; i < 3; ++i) store.append("g", numbered(100 + i));
+    }  // the destructor drains the queue
+
+    {
+        MessageStore store(dir.path, SEGMENT_BYTES, 0);
+        std::vector<std::string> main = recentText(store, "", 100);
+        CHECK(main.size() == 10);
+        if (main.size() == 10) CHECK(main.front() == numbered(0) && main.back() == numbered(9));
+        CHECK(recentText(store, "g", 100).size() == 3);
+
+        store.append("", numbered(10));
+        CHECK(waitForLines(store, "", 11));
+        main = recentText(store, "", 100);
+        CHECK(main.size() == 11);
+        if (main.size() == 11) CHECK(main.front() == numbered(0) && main.back() == numbered(10));
+    }
+
+    MessageStore store(dir.path, SEGMENT_BYTES, 0);
+    CHECK(recentText(store, "", 100).size() == 11);
+}
+
+// Bytes after the last whole record (here: garbage where a record would
+// start) end the scan, and appending resumes at that point
+static void testTornTail() {
+    TempDir dir;
+    {
+        MessageStore store(dir.path, SEGMENT_BYTES, 0);
+        for (int i = 0; i < 3; ++i) store.append("", numbered(i));
+    }
+
+    // Records are 8-byte aligned and the segment is zero-filled past them
+    std::string segment = dir.path + "/" + dir.segments().at(0);
+    int fd = open(segment.c_str(), O_RDWR);
+    std::vector<char> bytes(SEGMENT_BYTES);
+    CHECK(pread(fd, bytes.data(), bytes.size(), 0) == (ssize_t)bytes.size());
+    size_t end = bytes.size();
+    while (end > 0 && bytes[end - 1] == 0) --end;
+    end = (end + 7) & ~size_t(7);
+    CHECK(pwrite(fd, "JUNKJUNK", 8, end) == 8);
+    close(fd);
+
+    {
+        MessageStore store(dir.path, SEGMENT_BYTES, 0);
+        CHECK(recentText(store, "", 100).size() == 3);
+        store.append("", numbered(3));
+    }
+    MessageStore store(dir.path, SEGMENT_BYTES, 0);
+    CHECK((recentText(store, "", 100) ==
+           std::vector<std::string>{numbered(0), numbered(1), numbered(2), numbered(3)}));
+}
+
+// Appends roll to new segment files; with a retention limit the oldest
+// segments go, and what remains is an unbroken run ending at the newest line
+static void testSegmentRoll() {
+    const int lines = 300;
+    const size_t size = 1000;  // ~65 records per segment
+    TempDir unlimited, limited;
+    {
+        MessageStore keep_all(unlimited.path, SEGMENT_BYTES, 0);
+        MessageStore keep_two(limited.path, SEGMENT_BYTES, 2);
+        for (int i = 0; i < lines; ++i) {
+            CHECK(keep_all.append("", numbered(i, size)));
+            CHECK(keep_two.append("", numbered(i, size)));
+            // Stay under the writer's one-segment backlog limit
+            if (i % 32 == 31) {
+                waitForLines(keep_all, "", i + 1);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        }
+        CHECK(waitForLines(keep_all, "", lines));
+        CHECK(recentText(keep_all, "", lines).size() == (size_t)lines);
+    }
+    CHECK(unlimited.segments().size() >= 4);
+    CHECK(limited.segments().size() == 2);
+
+    MessageStore keep_all(unlimited.path, SEGMENT_BYTES, 0);
+    std::vector<std::string> all = recentText(keep_all, "", 1000);
+    CHECK(all.size() == (size_t)lines);
+    for (size_t i = 0; i < all.size(); ++i) CHECK(all[i] == numbered(i, size));
+
+    MessageStore keep_two(limited.path, SEGMENT_BYTES, 2);
+    std::vector<std::string> kept = recentText(keep_two, "", 1000);
+    CHECK(!kept.empty() && kept.size() < (size_t)lines);
+    for (size_t i = 0; i < kept.size(); ++i) CHECK(kept[i] == numbered(lines - kept.size() + i, size));
+}
+
+// resetChannel() hides everything before it, now and after a restart
+static void testResetChannel() {
+    TempDir dir;
+    {
+        MessageStore store(dir.path, SEGMENT_BYTES, 0);
+        store.append("g", "old group");
+        store.append("", "main");
+        CHECK(waitForLines(store, "g", 1));
+
+        store.resetChannel("g");
+        CHECK(recentText(store, "g", 10).empty());
+        store.append("g", "new group");
+        CHECK(waitForLines(store, "g", 1));
+        CHECK((recentText(store, "g", 10) == std::vector<std::string>{"new group"}));
+    }
+    {
+        MessageStore store(dir.path, SEGMENT_BYTES, 0);
+        CHECK((recentText(store, "g", 10) == std::vector<std::string>{"new group"}));
+        CHECK((recentText(store, "", 10) == std::vector<std::string>{"main"}));
+        store.resetChannel("g");
+    }
+    MessageStore store(dir.path, SEGMENT_BYTES, 0);
+    CHECK(recentText(store, "g", 10).empty());
+    CHECK(recentText(store, "", 10).size() == 1);
+}
+
+int main() {
+    testReadBack();
+    testRecovery();
+    testTornTail();
+    testSegmentRoll();
+    testResetChannel();
+    return ChatTest::finish("message_store");
+}
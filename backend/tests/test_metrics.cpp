@@ -0,0 +1,108 @@
+#include "histogram.hpp"
+#include "metrics.hpp"
+#include "logger.hpp"
+#include "check.hpp"
+#include <string>
+
+using namespace ChatServer;
+
+// Every value lands in a bucket whose ceiling is at most ~6% above it
+static void testBucketPrecision() {
+    const uint64_t values[] = {0, 1, 15, 16, 17, 100, 1000, 123456, 1ull << 40, 3ull << 61};
+    for (uint64_t value : values) {
+        LatencyHistogram h;
+        h.record(value);
+        CHECK(h.percentile(100) == value);  // capped at the largest value seen
+        CHECK(h.countAtOrBelow(value + value / 16) == 1);
+        if (value > 0) CHECK(h.countAtOrBelow(value - 1) == 0);
+    }
+
+    // The top bucket saturates instead of overflowing
+    LatencyHistogram top;
+    top.record(UINT64_MAX);
+    CHECK(top.percentile(50) == UINT64_MAX);
+    CHECK(top.countAtOrBelow(UINT64_MAX) == 1);
+}
+
+static void testPercentiles() {
+    LatencyHistogram h;
+    for (uint64_t v = 1; v <= 1000; ++v) h.record(v * 1000);
+    CHECK(h.count() == 1000);
+    CHECK(h.max() == 1000000);
+    CHECK(h.sum() == 500500ull * 1000);
+
+    uint64_t p50 = h.percentile(50), p99 = h.percentile(99);
+    CHECK(p50 >= 500000 && p50 <= 500000 * 107 / 100);
+    CHECK(p99 >= 990000 && p99 <= 1000000);
+    CHECK(h.percentile(50) <= h.percentile(90));
+    CHECK(LatencyHistogram().percentile(99) == 0);
+
+    // Only whole buckets count, so a bound never takes in values above it
+    CHECK(h.countAtOrBelow(999) == 0);
+    CHECK(h.countAtOrBelow(500000) <= 500);
+    CHECK(h.countAtOrBelow(500000) >= 500 * 94 / 100);
+    CHECK(h.countAtOrBelow(1000000 + 1000000 / 16) == 1000);
+}
+
+static void testMergeAndSnapshot() {
+    LatencyHistogram a, b;
+    ConcurrentHistogram shared;
+    for (uint64_t v = 0; v < 500; ++v) {
+        a.record(v);
+        shared.record(v);
+    }
+    for (uint64_t v = 500; v < 1000; ++v) {
+        b.record(v);
+        shared.record(v);
+    }
+    a.merge(b);
+
+    LatencyHistogram snapshot;
+    shared.snapshotInto(snapshot);
+    CHECK(snapshot.count() == a.count());
+    CHECK(snapshot.sum() == a.sum());
+    CHECK(snapshot.max() == a.max());
+    for (double p : {1.0, 50.0, 99.0, 99.9}) CHECK(snapshot.percentile(p) == a.percentile(p));
+
+    a.reset();
+    CHECK(a.count() == 0 && a.max() == 0 && a.percentile(50) == 0);
+}
+
+static bool contains(const std::string& text, const std::string& line) {
+    return text.find(line + "\n") != std::string::npos;
+}
+
+static void testRender() {
+    Logger logger("/dev/null", 16, 0, 0);
+    Metrics metrics(2, {"msg", "chat"}, logger);
+    metrics.shard(0).accepted.add(3);
+    metrics.shard(1).accepted.add();
+    metrics.shard(1).connected.add(5);
+    metrics.shard(1).connected.add(-2);
+    metrics.shard(0).handled[0].add(2);
+    metrics.shard(1).handled[0].add(4);
+    metrics.shard(0).handler_latency[1].record(500);         // 0.5 us
+    metrics.shard(1).handler_latency[1].record(50000000);    // 50 ms
+
+    std::string text = metrics.render();
+    CHECK(contains(text, "# TYPE chat_connections_accepted_total counter"));
+    CHECK(contains(text, "chat_connections_accepted_total{shard=\"0\"} 3"));
+    CHECK(contains(text, "chat_connections_accepted_total{shard=\"1\"} 1"));
+    CHECK(contains(text, "chat_connections{shard=\"1\"} 3"));
+    // Per-handler series are summed over shards
+    CHECK(contains(text, "chat_commands_total{command=\"msg\"} 6"));
+    CHECK(contains(text, "chat_command_duration_seconds_bucket{command=\"chat\",le=\"1e-06\"} 1"));
+    CHECK(contains(text, "chat_command_duration_seconds_bucket{command=\"chat\",le=\"0.01\"} 1"));
+    CHECK(contains(text, "chat_command_duration_seconds_bucket{command=\"chat\",le=\"0.1\"} 2"));
+    CHECK(contains(text, "chat_command_duration_seconds_bucket{command=\"chat\",le=\"+Inf\"} 2"));
+    CHECK(contains(text, "chat_command_duration_seconds_count{command=\"chat\"} 2"));
+    CHECK(contains(text, "chat_command_duration_seconds_sum{command=\"chat\"} 0.050000500"));
+}
+
+int main() {
+    testBucketPrecision();
+    testPercentiles();
+    testMergeAndSnapshot();
+    testRender();
+    return ChatTest::finish("metrics");
+}
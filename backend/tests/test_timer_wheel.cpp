@@ -0,0 +1,119 @@
+#include "timer_wheel.hpp"
+#include "check.hpp"
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace ChatServer;
+
+// Tick on which each timer came due, by owner
+static std::map<int, uint64_t> runUntil(TimerWheel& wheel, uint64_t end) {
+    std::map<int, uint64_t> fired;
+    std::vector<ExpiredTimer> expired;
+    while (wheel.now() < end) {
+        expired.clear();
+        wheel.advance(wheel.now() + 1, expired);
+        for (const ExpiredTimer& timer : expired) {
+            CHECK(fired.count(timer.owner) == 0);
+            fired[timer.owner] = wheel.now();
+        }
+    }
+    return fired;
+}
+
+// Delays on both sides of every level boundary fire on exactly their tick,
+// from a start that isn't aligned to any level
+static void testCascadeBoundaries() {
+    const uint64_t delays[] = {1, 2, 63, 64, 65, 127, 128, 4095, 4096, 4097, 4160,
+                               262143, 262144, 262145, 300000, 1ull << 20};
+    const uint64_t start = 1000037;
+    TimerWheel wheel(start);
+    for (size_t i = 0; i < std::size(delays); ++i) wheel.schedule(delays[i], (int)i, 7);
+    CHECK(wheel.size() == std::size(delays));
+
+    std::map<int, uint64_t> fired = runUntil(wheel, start + (1ull << 20) + 1);
+    CHECK(fired.size() == std::size(delays));
+    for (size_t i = 0; i < std::size(delays); ++i) CHECK(fired[(int)i] == start + delays[i]);
+    CHECK(wheel.size() == 0);
+}
+
+static void testClampAndOrder() {
+    TimerWheel wheel(5);
+    wheel.schedule(0, 1, 0);  // at least one tick
+    wheel.schedule(TimerWheel::MAX_DELAY + 1000, 2, 0);
+
+    std::vector<ExpiredTimer> expired;
+    wheel.advance(5, expired);
+    CHECK(expired.empty());
+    wheel.advance(6, expired);
+    CHECK(expired.size() == 1 && expired[0].owner == 1);
+
+    std::map<int, uint64_t> fired = runUntil(wheel, 5 + TimerWheel::MAX_DELAY);
+    CHECK(fired.size() == 1 && fired[2] == 5 + TimerWheel::MAX_DELAY);
+}
+
+static void testCancel() {
+    TimerWheel wheel;
+    TimerId keep = wheel.schedule(100, 1, 3);
+    TimerId drop = wheel.schedule(5000, 2, 3);
+    wheel.schedule(5000, 3, 3);
+    wheel.cancel(drop);
+    CHECK(wheel.size() == 2);
+
+    // A cancelled id is handed out again
+    TimerId reused = wheel.schedule(70, 4, 3);
+    CHECK(reused == drop);
+    CHECK(reused != keep);
+
+    std::map<int, uint64_t> fired = runUntil(wheel, 6000);
+    CHECK(fired.size() == 3);
+    CHECK(fired.count(2) == 0);
+    CHECK(fired[1] == 100 && fired[3] == 5000 && fired[4] == 70);
+}
+
+// Random schedules, cancels and jumps of time: every live timer fires in
+// the advance() that passes its tick, and never otherwise
+static void testRandomAgainstReference() {
+    std::mt19937_64 rng(12345);
+    TimerWheel wheel(777);
+    std::map<int, std::pair<TimerId, uint64_t>> pending;  // owner -> id, due tick
+    std::vector<ExpiredTimer> expired;
+    int next_owner = 0;
+
+    for (int round = 0; round < 20000; ++round) {
+        uint64_t roll = rng() % 100;
+        if (roll < 50) {
+            uint64_t delay = 1 + rng() % (rng() % 4 == 0 ? 300000 : 200);
+            int owner = next_owner++;
+            pending[owner] = {wheel.schedule(delay, owner, 0), wheel.now() + delay};
+        } else if (roll < 60 && !pending.empty()) {
+            auto it = pending.begin();
+            std::advance(it, rng() % pending.size());
+            wheel.cancel(it->second.first);
+            pending.erase(it);
+        } else {
+            uint64_t from = wheel.now();
+            uint64_t to = from + rng() % (rng() % 8 == 0 ? 5000 : 20);
+            expired.clear();
+            wheel.advance(to, expired);
+            for (const ExpiredTimer& timer : expired) {
+                auto it = pending.find(timer.owner);
+                CHECK(it != pending.end());
+                if (it == pending.end()) continue;
+                CHECK(it->second.first == timer.id);
+                CHECK(it->second.second > from && it->second.second <= to);
+                pending.erase(it);
+            }
+            for (const auto& [owner, timer] : pending) CHECK(timer.second > to);
+        }
+        CHECK(wheel.size() == pending.size());
+    }
+}
+
+int main() {
+    testCascadeBoundaries();
+    testClampAndOrder();
+    testCancel();
+    testRandomAgainstReference();
+    return ChatTest::finish("timer_wheel");
+}
@@ -0,0 +1,36 @@
+#include "utils.hpp"
+#include "check.hpp"
+
+using namespace ChatServer;
+
+static void testTrimView() {
+    CHECK(trimView("  hello \t") == "hello");
+    CHECK(trimView("hello") == "hello");
+    CHECK(trimView("   ").empty());
+    CHECK(trimView("").empty());
+    CHECK(trimView(" a b ") == "a b");
+    CHECK(trim("  x y\n") == "x y");
+}
+
+static void testSplitToken() {
+    auto [name, args] = splitToken("msg bob  hello there ");
+    CHECK(name == "msg");
+    CHECK(args == "bob  hello there");
+
+    auto [only, none] = splitToken("  list  ");
+    CHECK(only == "list");
+    CHECK(none.empty());
+
+    auto [tab_name, tab_args] = splitToken("gmsg\tg hi");
+    CHECK(tab_name == "gmsg");
+    CHECK(tab_args == "g hi");
+
+    auto [empty_name, empty_args] = splitToken("");
+    CHECK(empty_name.empty() && empty_args.empty());
+}
+
+int main() {
+    testTrimView();
+    testSplitToken();
+    return ChatTest::finish("utils");
+}
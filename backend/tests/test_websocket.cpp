@@ -0,0 +1,177 @@
+#include "websocket.hpp"
+#include "check.hpp"
+#include <string>
+
+using namespace ChatServer;
+using Decode = WebSocketFrame::Decode;
+
+static std::string bytes(std::initializer_list<int> values) {
+    std::string out;
+    for (int v : values) out += (char)v;
+    return out;
+}
+
+// Client frame: FIN set, masked with a fixed key
+static std::string clientFrame(uint8_t opcode, const std::string& payload, bool fin = true) {
+    static const uint8_t key[4] = {0x11, 0x22, 0x33, 0x44};
+    std::string frame;
+    frame += (char)((fin ? 0x80 : 0) | opcode);
+    if (payload.size() < 126) {
+        frame += (char)(0x80 | payload.size());
+    } else if (payload.size() <= UINT16_MAX) {
+        frame += (char)(0x80 | 126);
+        frame += (char)(payload.size() >> 8);
+        frame += (char)payload.size();
+    } else {
+        frame += (char)(0x80 | 127);
+        for (int i = 7; i >= 0; --i) frame += (char)((uint64_t)payload.size() >> (8 * i));
+    }
+    frame.append((const char*)key, 4);
+    for (size_t i = 0; i < payload.size(); ++i) frame += (char)(payload[i] ^ key[i & 3]);
+    return frame;
+}
+
+// RFC 6455 section 5.7: a single-frame masked text message
+static void testRfcExample() {
+    std::string frame = bytes({0x81, 0x85, 0x37, 0xfa, 0x21, 0x3d, 0x7f, 0x9f, 0x4d, 0x51, 0x58});
+    WebSocketFrame header;
+    CHECK(WebSocketFrame::decodeHeader(frame, header) == Decode::OK);
+    CHECK(header.fin && header.opcode == WebSocketFrame::TEXT && !header.isControl());
+    CHECK(header.length == 5 && header.header_size == 6);
+
+    std::string payload = frame.substr(header.header_size);
+    WebSocketFrame::unmask(payload.data(), payload.size(), header.mask, 0);
+    CHECK(payload == "Hello");
+}
+
+static void testLengths() {
+    for (size_t size : {0ul, 125ul, 126ul, 65535ul, 65536ul, 200000ul}) {
+        std::string frame = clientFrame(WebSocketFrame::BINARY, std::string(size, 'z'));
+        WebSocketFrame header;
+        CHECK(WebSocketFrame::decodeHeader(frame, header) == Decode::OK);
+        CHECK(header.length == size);
+        CHECK(header.header_size == (size < 126 ? 6u : size <= 65535 ? 8u : 14u));
+        CHECK(frame.size() == header.header_size + size);
+
+        // Every strict prefix of the header is incomplete
+        for (size_t n = 0; n < header.header_size; ++n)
+            CHECK(WebSocketFrame::decodeHeader(std::string_view(frame).substr(0, n), header) == Decode::INCOMPLETE);
+    }
+}
+
+static void testInvalid() {
+    WebSocketFrame header;
+    std::string frame = clientFrame(WebSocketFrame::TEXT, "hi");
+
+    std::string unmasked = frame;
+    unmasked[1] = (char)(unmasked[1] & 0x7f);
+    CHECK(WebSocketFrame::decodeHeader(unmasked, header) == Decode::INVALID);
+
+    for (int rsv : {0x40, 0x20, 0x10}) {
+        std::string reserved = frame;
+        reserved[0] = (char)(reserved[0] | rsv);
+        CHECK(WebSocketFrame::decodeHeader(reserved, header) == Decode::INVALID);
+    }
+    for (uint8_t opcode : {3, 7, 0xB, 0xF})
+        CHECK(WebSocketFrame::decodeHeader(clientFrame(opcode, "x"), header) == Decode::INVALID);
+
+    // Control frames: at most 125 bytes and never fragmented
+    CHECK(WebSocketFrame::decodeHeader(clientFrame(WebSocketFrame::PING, std::string(125, 'p')), header) == Decode::OK);
+    CHECK(header.isControl());
+    CHECK(WebSocketFrame::decodeHeader(clientFrame(WebSocketFrame::PING, std::string(126, 'p')), header) == Decode::INVALID);
+    CHECK(WebSocketFrame::decodeHeader(clientFrame(WebSocketFrame::CLOSE, "", false), header) == Decode::INVALID);
+    // Data frames may be fragmented
+    CHECK(WebSocketFrame::decodeHeader(clientFrame(WebSocketFrame::TEXT, "part", false), header) == Decode::OK);
+    CHECK(!header.fin);
+
+    // A 64-bit length with the top bit set
+    std::string huge = bytes({0x82, 0xff, 0x80, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4});
+    CHECK(WebSocketFrame::decodeHeader(huge, header) == Decode::INVALID);
+}
+
+// Unmasking in pieces at their payload offsets matches unmasking at once
+static void testUnmaskOffsets() {
+    std::string payload;
+    for (int i = 0; i < 100; ++i) payload += (char)('a' + i % 26);
+    std::string frame = clientFrame(WebSocketFrame::TEXT, payload);
+    WebSocketFrame header;
+    CHECK(WebSocketFrame::decodeHeader(frame, header) == Decode::OK);
+
+    std::string masked = frame.substr(header.header_size);
+    std::string whole = masked;
+    WebSocketFrame::unmask(whole.data(), whole.size(), header.mask, 0);
+    CHECK(whole == payload);
+
+    for (size_t split : {1ul, 3ul, 7ul, 8ul, 13ul, 64ul}) {
+        std::string pieces = masked;
+        for (size_t at = 0; at < pieces.size(); at += split)
+            WebSocketFrame::unmask(pieces.data() + at, std::min(split, pieces.size() - at), header.mask, at);
+        CHECK(pieces == payload);
+    }
+}
+
+static void testEncodeHeader() {
+    char out[WebSocketFrame::MAX_SERVER_HEADER];
+    CHECK(WebSocketFrame::encodeHeader(out, WebSocketFrame::TEXT, 5) == 2);
+    CHECK(std::string(out, 2) == bytes({0x81, 5}));
+    CHECK(WebSocketFrame::encodeHeader(out, WebSocketFrame::BINARY, 126) == 4);
+    CHECK(std::string(out, 4) == bytes({0x82, 126, 0, 126}));
+    CHECK(WebSocketFrame::encodeHeader(out, WebSocketFrame::TEXT, 65536) == 10);
+    CHECK(std::string(out, 10) == bytes({0x81, 127, 0, 0, 0, 0, 0, 1, 0, 0}));
+    CHECK(WebSocketFrame::encodeHeader(out, WebSocketFrame::PONG, 0) == 2);
+    CHECK(std::string(out, 2) == bytes({0x8A, 0}));
+}
+
+static const std::string REQUEST =
+    "GET /chat HTTP/1.1\r\n"
+    "Host: server.example.com\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: keep-alive, Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n\r\n";
+
+static Decode parse(const std::string& request) {
+    std::string_view key;
+    size_t size = 0;
+    return parseUpgradeRequest(request, key, size);
+}
+
+static std::string replaced(std::string text, const std::string& from, const std::string& to) {
+    text.replace(text.find(from), from.size(), to);
+    return text;
+}
+
+static void testHandshake() {
+    std::string buffered = REQUEST + bytes({0x81, 0x80});  // a frame already behind it
+    std::string_view key;
+    size_t size = 0;
+    CHECK(parseUpgradeRequest(buffered, key, size) == Decode::OK);
+    CHECK(key == "dGhlIHNhbXBsZSBub25jZQ==");
+    CHECK(size == REQUEST.size());
+
+    // RFC 6455 section 1.3
+    std::string response = upgradeResponse(key);
+    CHECK(response.find("HTTP/1.1 101 Switching Protocols\r\n") == 0);
+    CHECK(response.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != std::string::npos);
+    CHECK(response.size() >= 4 && response.compare(response.size() - 4, 4, "\r\n\r\n") == 0);
+
+    CHECK(parse(REQUEST.substr(0, REQUEST.size() - 2)) == Decode::INCOMPLETE);
+    CHECK(parse(std::string(9000, 'a')) == Decode::INVALID);  // no end in sight
+    CHECK(parse(replaced(REQUEST, "Sec-WebSocket-Version", "sec-websocket-version")) == Decode::OK);
+    CHECK(parse(replaced(REQUEST, "Upgrade: websocket", "upgrade:  WebSocket ")) == Decode::OK);
+    CHECK(parse(replaced(REQUEST, "GET ", "POST ")) == Decode::INVALID);
+    CHECK(parse(replaced(REQUEST, "HTTP/1.1", "HTTP/1.0")) == Decode::INVALID);
+    CHECK(parse(replaced(REQUEST, "keep-alive, Upgrade", "keep-alive")) == Decode::INVALID);
+    CHECK(parse(replaced(REQUEST, "Version: 13", "Version: 8")) == Decode::INVALID);
+    CHECK(parse(replaced(REQUEST, "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n", "")) == Decode::INVALID);
+}
+
+int main() {
+    testRfcExample();
+    testLengths();
+    testInvalid();
+    testUnmaskOffsets();
+    testEncodeHeader();
+    testHandshake();
+    return ChatTest::finish("websocket");
+}